@@ -21,6 +21,11 @@ EPILOGUE = "}"
 
 NODE_COUNT = 0
 
+# Execution counts from 'parser -p ... -j' are fields of the node,
+# not children.  Nodes are shaded by how hot they are.
+COUNT_FIELDS = ("hits_", "taken_", "not_taken_")
+MAX_HITS = 0
+
 def gen_name() -> str:
     """Return a unique node name"""
     global NODE_COUNT
@@ -55,15 +60,48 @@ def dump_structure(node: dict, name: str, to_stream: IOBase):
     plus all the descendents of root in the AST structure.
     """
     log.debug(f"""A dict structure with kind {node["kind"]}""")
-    print(f"""{name}[shape=box,label="{node["kind"]}"];""",file=to_stream)
+    if "hits_" in node:
+        hits = node["hits_"]
+        print(f"""{name}[shape=box,style=filled,fillcolor="{heat_color(hits)}",""" +
+              f"""label="{node["kind"]}\\n{hits}"];""", file=to_stream)
+    else:
+        print(f"""{name}[shape=box,label="{node["kind"]}"];""",file=to_stream)
     for field in node:
-        if field == "kind":
+        if field == "kind" or field in COUNT_FIELDS:
             # Treated specially above
             continue
         child = node[field]
         child_name = gen_name()
         dump_node(child, child_name, to_stream)
-        print(f"""{name} -> {child_name} [taillabel="{field}"];""")
+        print(f"""{name} -> {child_name} [taillabel="{field}"{edge_style(node, field)}];""")
+
+def find_max_hits(node: Union[dict, list]) -> int:
+    """Largest execution count anywhere in the tree"""
+    if isinstance(node, dict):
+        return max([node.get("hits_", 0)] +
+                   [find_max_hits(node[field]) for field in node if field not in COUNT_FIELDS])
+    if isinstance(node, list):
+        return max([0] + [find_max_hits(child) for child in node])
+    return 0
+
+
+def heat_color(hits: int) -> str:
+    """White for code never executed, through yellow, to red for the hottest"""
+    if hits == 0 or MAX_HITS == 0:
+        return "white"
+    heat = hits / MAX_HITS
+    return f"0.{int(16 * (1 - heat)):02d} {0.3 + 0.7 * heat:.2f} 1.0"
+
+
+def edge_style(node: dict, field: str) -> str:
+    """The arms of a profiled 'if' are labeled with how often each ran"""
+    if "taken_" not in node or field not in ("truepart_", "falsepart_"):
+        return ""
+    count = node["taken_"] if field == "truepart_" else node["not_taken_"]
+    other = node["not_taken_"] if field == "truepart_" else node["taken_"]
+    style = ",style=bold" if count > other else ",style=dashed" if count == 0 else ""
+    return f""",headlabel="{count}"{style}"""
+
 
 def dump_list(node: list, name: str, to_stream: IOBase):
     """Dump a representation of a list (e.g., block of statements),
@@ -91,6 +129,8 @@ def main():
     #TBD: Give this a decent CLI
     source = sys.argv[1]
     ast = load(source)
+    global MAX_HITS
+    MAX_HITS = find_max_hits(ast)
     print(PROLOGUE)
     dump_node(ast,"root")
     print(EPILOGUE)
@@ -0,0 +1,22 @@
+#! /bin/sh
+#
+# Compare the C code from 'parser -c' (three-address code and gotos)
+# with 'parser -C' (structured C) on a large generated program:
+# size of the generated code, and how long gcc takes to compile it.
+#
+# Usage:  bench/compile_time.sh [n_statements] [gcc flags]
+# Run from the top-level directory, after building bin/parser.
+#
+n=${1:-20000}
+cflags=${2:-"-O2"}
+dir=$(mktemp -d)
+python3 bench/gen_program.py $n > $dir/prog.calc
+for mode in c C; do
+    bin/parser -$mode $dir/prog.calc 2>/dev/null | grep -v "GENERATED CODE" > $dir/prog_$mode.c
+    bytes=$(wc -c < $dir/prog_$mode.c)
+    start=$(date +%s%N)
+    gcc $cflags -w -o $dir/prog_$mode $dir/prog_$mode.c
+    end=$(date +%s%N)
+    echo "parser -$mode: $bytes bytes of C, gcc $cflags took $(( (end - start) / 1000000 )) ms"
+done
+rm -rf $dir
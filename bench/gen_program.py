@@ -0,0 +1,56 @@
+#
+# Generate a large random calculator program, for benchmarks.
+#
+# Usage:  python3 gen_program.py n_statements [seed] > big.calc
+#
+# Programs use only + - * (no division, so no division by zero),
+# a handful of variables, and if/elif/else nested a few levels deep.
+#
+
+import random
+import sys
+
+VARS = [f"v{i}" for i in range(12)]
+
+
+def expr(depth: int = 0) -> str:
+    if depth > 3 or random.random() < 0.3:
+        if random.random() < 0.6:
+            return random.choice(VARS)
+        return str(random.randrange(100))
+    text = f"{expr(depth + 1)} {random.choice('+-*')} {expr(depth + 1)}"
+    return f"({text})" if random.random() < 0.5 else text
+
+
+def cond(depth: int = 0) -> str:
+    r = random.random()
+    if depth < 2 and r < 0.2:
+        return f"{cond(depth + 1)} and {cond(depth + 1)}"
+    if depth < 2 and r < 0.4:
+        return f"{cond(depth + 1)} or {cond(depth + 1)}"
+    if depth < 2 and r < 0.5:
+        return f"not {cond(depth + 1)}"
+    return f"{expr(2)} {random.choice(['<', '>', '<=', '>=', '=='])} {expr(2)}"
+
+
+def stmts(n: int, depth: int = 0) -> str:
+    out = []
+    for _ in range(n):
+        r = random.random()
+        if depth < 3 and r < 0.1:
+            text = f"if {cond()} then\n{stmts(random.randrange(1, 5), depth + 1)}\n"
+            while random.random() < 0.4:
+                text += f"elif {cond()} then\n{stmts(random.randrange(1, 4), depth + 1)}\n"
+            if random.random() < 0.5:
+                text += f"else\n{stmts(random.randrange(1, 4), depth + 1)}\n"
+            out.append(text + "fi")
+        else:
+            out.append(f"{random.choice(VARS)} = {expr()}")
+    return "\n".join(out)
+
+
+if __name__ == "__main__":
+    n = int(sys.argv[1])
+    random.seed(int(sys.argv[2]) if len(sys.argv) > 2 else 461)
+    print(stmts(n))
+    print(" + ".join(VARS))
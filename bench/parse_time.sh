@@ -0,0 +1,27 @@
+#! /bin/sh
+#
+# Parse throughput of the Bison parser and the recursive descent parser
+# ('parser -d') on a large generated program.  With no output option
+# the parser only scans and parses; the fast scanner ('-F') is used for
+# both, so that scanning is a smaller part of the time.  Each is run
+# three times and the best time is reported.
+#
+# Usage:  bench/parse_time.sh [n_statements]
+# Run from the top-level directory, after building bin/parser.
+#
+n=${1:-400000}
+dir=$(mktemp -d)
+python3 bench/gen_program.py $n > $dir/prog.calc
+bytes=$(wc -c < $dir/prog.calc)
+for parser in "" "-d"; do
+    best=0
+    for run in 1 2 3; do
+        start=$(date +%s%N)
+        bin/parser -F $parser $dir/prog.calc > /dev/null 2>&1
+        end=$(date +%s%N)
+        ms=$(( (end - start) / 1000000 ))
+        if [ $best -eq 0 ] || [ $ms -lt $best ]; then best=$ms; fi
+    done
+    echo "parser -F${parser:+ $parser}: $bytes bytes in $best ms, $(( bytes / 1000 / (best + 1) )) MB/s"
+done
+rm -rf $dir
@@ -0,0 +1,36 @@
+#! /bin/sh
+#
+# Scan and parse time of the reflex scanner in the parser's thread
+# and in a thread of its own ('parser -t'), on a large generated
+# program.  With no output option the parser only scans and parses.
+# Each is run three times and the best time is reported.  First the
+# two must print the same tree ('-j'), or the timing means nothing.
+# On a machine with one core, -t is ignored (with a note on stderr),
+# so both are the same.
+#
+# Usage:  bench/pipeline_time.sh [n_statements]
+# Run from the top-level directory, after building bin/parser.
+#
+n=${1:-400000}
+dir=$(mktemp -d)
+python3 bench/gen_program.py $n > $dir/prog.calc
+bytes=$(wc -c < $dir/prog.calc)
+bin/parser -j $dir/prog.calc > $dir/plain.json 2> /dev/null
+bin/parser -t -j $dir/prog.calc > $dir/pipelined.json 2> /dev/null
+if ! cmp -s $dir/plain.json $dir/pipelined.json; then
+    echo "parser -t -j and parser -j disagree"
+    rm -rf $dir
+    exit 1
+fi
+for mode in "" "-t"; do
+    best=0
+    for run in 1 2 3; do
+        start=$(date +%s%N)
+        bin/parser $mode $dir/prog.calc > /dev/null 2>&1
+        end=$(date +%s%N)
+        ms=$(( (end - start) / 1000000 ))
+        if [ $best -eq 0 ] || [ $ms -lt $best ]; then best=$ms; fi
+    done
+    echo "parser${mode:+ $mode}: $bytes bytes in $best ms, $(( bytes / 1000 / (best + 1) )) MB/s"
+done
+rm -rf $dir
@@ -0,0 +1,59 @@
+#
+# Round-trip latency of 'parser -S' (server mode) as a client sees it,
+# compared with starting 'bin/parser -e' once per program.
+#
+# Usage:  python3 bench/server_latency.py [n_requests]
+# Run from the top-level directory, after building bin/parser.
+#
+
+import subprocess
+import sys
+import time
+
+PROGRAM = "x = 3\ny = x * 4\nif y > 10 then z = y - 1 else z = 2 fi\nz\n"
+
+
+class Client:
+    def __init__(self):
+        self.proc = subprocess.Popen(["bin/parser", "-S"],
+                                     stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+
+    def request(self, action: str, text: str):
+        data = text.encode()
+        self.proc.stdin.write(f"{action} {len(data)}\n".encode() + data)
+        self.proc.stdin.flush()
+        status, length, micros, cached = self.proc.stdout.readline().split()
+        body = self.proc.stdout.read(int(length))
+        return status.decode(), body.decode()
+
+    def close(self):
+        self.proc.stdin.close()
+        self.proc.wait()
+
+
+def round_trip(client: Client, n: int, vary: bool) -> float:
+    start = time.perf_counter()
+    for i in range(n):
+        # Varying the text defeats the server's cache of parsed programs
+        text = PROGRAM + f"w{i} = {i}\n" if vary else PROGRAM
+        status, body = client.request("eval", text)
+        assert status == "ok", body
+    return (time.perf_counter() - start) / n * 1e6
+
+
+def main():
+    n = int(sys.argv[1]) if len(sys.argv) > 1 else 10000
+    client = Client()
+    print(f"server, cached program:   {round_trip(client, n, False):8.1f} us per request")
+    print(f"server, new program:      {round_trip(client, n, True):8.1f} us per request")
+    client.close()
+    runs = max(n // 100, 10)
+    start = time.perf_counter()
+    for _ in range(runs):
+        subprocess.run(["bin/parser", "-e"], input=PROGRAM.encode(),
+                       stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    print(f"new process per program:  {(time.perf_counter() - start) / runs * 1e6:8.1f} us per request")
+
+
+if __name__ == "__main__":
+    main()
@@ -3,7 +3,11 @@
 //
 
 #include "ASTNode.h"
+#include "PartialEval.h"
 #include <stdlib.h>
+#include <algorithm>
+#include <climits>
+#include <map>
 
 namespace AST {
     // Abstract syntax tree.  ASTNode is abstract base class for all other nodes.
@@ -12,33 +16,47 @@ namespace AST {
     // a few require more code.
 
 
+    thread_local NodeArena* NodeArena::current_ = nullptr;
+
+    void NodeArena::clear() {
+        for (ASTNode* node : nodes_) { delete node; }
+        nodes_.clear();
+    }
+
     /* ============   Immediate Evaluation (Calculator Model) ================== */
 
     /* Binary operators */
-    int Plus::eval(EvalContext &ctx) { return left_.eval(ctx) + right_.eval(ctx); }
+    int Plus::eval_node(EvalContext &ctx) { return left_.eval(ctx) + right_.eval(ctx); }
 
-    int Times::eval(EvalContext &ctx) { return left_.eval(ctx) * right_.eval(ctx); }
+    int Times::eval_node(EvalContext &ctx) { return left_.eval(ctx) * right_.eval(ctx); }
 
-    int Minus::eval(EvalContext &ctx) { return left_.eval(ctx) - right_.eval(ctx); }
+    int Minus::eval_node(EvalContext &ctx) { return left_.eval(ctx) - right_.eval(ctx); }
 
-    int Div::eval(EvalContext &ctx) { return left_.eval(ctx) / right_.eval(ctx); }
+    int Div::eval_node(EvalContext &ctx) {
+        int left = left_.eval(ctx);
+        int right = right_.eval(ctx);
+        if (ctx.checked_division && (right == 0 || (right == -1 && left == INT_MIN))) {
+            throw DivisionError(right == 0 ? "division by zero" : "division overflow");
+        }
+        return left / right;
+    }
 
     // C is already short-circuit for && and || so we can use them directly for calculator mode
-    int And::eval(EvalContext &ctx) { return left_.eval(ctx) && right_.eval(ctx); }
-    int Or::eval(EvalContext &ctx) { return left_.eval(ctx) || right_.eval(ctx); }
-    int Not::eval(EvalContext &ctx) { return ! (left_.eval(ctx)); }
+    int And::eval_node(EvalContext &ctx) { return left_.eval(ctx) && right_.eval(ctx); }
+    int Or::eval_node(EvalContext &ctx) { return left_.eval(ctx) || right_.eval(ctx); }
+    int Not::eval_node(EvalContext &ctx) { return ! (left_.eval(ctx)); }
 
     /* Comparisons work like binary operators in calculator mode */
-    int Less::eval(EvalContext &ctx) { return left_.eval(ctx) < right_.eval(ctx); }
-    int AtMost::eval(EvalContext &ctx) { return left_.eval(ctx) <= right_.eval(ctx); }
-    int AtLeast::eval(EvalContext &ctx) { return left_.eval(ctx) >= right_.eval(ctx); }
-    int Greater::eval(EvalContext &ctx) { return left_.eval(ctx) > right_.eval(ctx); }
-    int Equals::eval(EvalContext &ctx) { return left_.eval(ctx) == right_.eval(ctx); }
+    int Less::eval_node(EvalContext &ctx) { return left_.eval(ctx) < right_.eval(ctx); }
+    int AtMost::eval_node(EvalContext &ctx) { return left_.eval(ctx) <= right_.eval(ctx); }
+    int AtLeast::eval_node(EvalContext &ctx) { return left_.eval(ctx) >= right_.eval(ctx); }
+    int Greater::eval_node(EvalContext &ctx) { return left_.eval(ctx) > right_.eval(ctx); }
+    int Equals::eval_node(EvalContext &ctx) { return left_.eval(ctx) == right_.eval(ctx); }
 
     // A block is evaluated just by evaluating each statement in the block.
     // We'll return the value_ of the last statement, although it is useless.
     // The value_ of an empty block is zero.
-    int Block::eval(EvalContext &ctx) {
+    int Block::eval_node(EvalContext &ctx) {
         int result = 0;
         for (auto &s: stmts_) {
             result = s->eval(ctx);
@@ -48,7 +66,7 @@ namespace AST {
 
 
     // Identifiers live in symtab and default to 0.
-    int Ident::eval(EvalContext &ctx) {
+    int Ident::eval_node(EvalContext &ctx) {
         if (ctx.symtab.count(text_) == 1) {
             return ctx.symtab[text_];
         } else {
@@ -60,7 +78,7 @@ namespace AST {
     // result into its left_ hand side.  We'll have it return the
     // value_ it produced just for simplicity and debugging, but the
     // value_ is not otherwise used.
-    int Assign::eval(EvalContext &ctx) {
+    int Assign::eval_node(EvalContext &ctx) {
         std::string loc = lexpr_.l_eval(ctx);
         int rvalue = rexpr_.eval(ctx);
         ctx.symtab[loc] = rvalue;
@@ -70,8 +88,9 @@ namespace AST {
     // An 'if' statement, in this initial cut, evaluates its condition to an integer
     // and chooses the true (then) part or the false (else) part depending on whether
     // the integer is zero.
-    int If::eval(EvalContext &ctx) {
+    int If::eval_node(EvalContext &ctx) {
         int cond = cond_.eval(ctx);
+        if (ctx.profile) { ctx.profile->branch(this, cond != 0); }
         // Might as well use C's ill-considered interpretation of ints as booleans
         if (cond) {
             return truepart_.eval(ctx);
@@ -79,7 +98,11 @@ namespace AST {
         return falsepart_.eval(ctx);
     }
 
-    int AsBool::eval(EvalContext &ctx) {
+    Block* If::select(EvalContext &ctx) {
+        return cond_.eval(ctx) ? &truepart_ : &falsepart_;
+    }
+
+    int AsBool::eval_node(EvalContext &ctx) {
         // For calculator mode, we will just use the
         // arithmetic value as a boolean, as C does.
         return  left_.eval(ctx);
@@ -87,6 +110,191 @@ namespace AST {
 
 
 
+    /* A dense table may have some holes, which go to the default,
+     * but not too many.
+     */
+    Switch::Switch(Ident &var, std::vector<std::pair<int, Block*>> cases, Block &default_part) :
+            var_{var}, cases_{cases}, default_{default_part}, table_base_{0} {
+        long low = cases_[0].first, high = cases_[0].first;
+        for (auto &c: cases_) {
+            low = std::min(low, (long) c.first);
+            high = std::max(high, (long) c.first);
+        }
+        if (high - low < 2 * (long) cases_.size()) {
+            table_base_ = (int) low;
+            table_.assign(high - low + 1, &default_);
+            for (auto &c: cases_) { table_[c.first - low] = c.second; }
+        } else {
+            for (auto &c: cases_) { lookup_[c.first] = c.second; }
+        }
+    }
+
+    Block* Switch::arm(int value) {
+        if (! table_.empty()) {
+            long index = (long) value - table_base_;
+            if (index >= 0 && index < (long) table_.size()) { return table_[index]; }
+            return &default_;
+        }
+        auto found = lookup_.find(value);
+        return found == lookup_.end() ? &default_ : found->second;
+    }
+
+    int Switch::eval_node(EvalContext &ctx) {
+        return arm(var_.eval(ctx))->eval(ctx);
+    }
+
+    void Switch::children(std::vector<ASTNode*>& kids) {
+        kids.push_back(&var_);
+        for (auto &c: cases_) { kids.push_back(c.second); }
+        kids.push_back(&default_);
+    }
+
+
+    /* ============   Dependence analysis ================== */
+
+    void Block::uses(VarUse &use) {
+        for (auto &s: stmts_) {
+            s->uses(use);
+        }
+    }
+
+    void Assign::uses(VarUse &use) {
+        lexpr_.l_uses(use);
+        rexpr_.uses(use);
+    }
+
+    void If::uses(VarUse &use) {
+        cond_.uses(use);
+        truepart_.uses(use);
+        falsepart_.uses(use);
+    }
+
+
+    void Switch::uses(VarUse &use) {
+        var_.uses(use);
+        for (auto &c: cases_) { c.second->uses(use); }
+        default_.uses(use);
+    }
+
+
+    /* ============   Lowering to SSA intermediate representation ================== */
+
+    // Like eval, the value of a block is the value of its last
+    // statement, or zero if it is empty.
+    ir::Instr* Block::lower(ir::Builder& b) {
+        ir::Instr* result = b.constant(0);
+        for (auto &s: stmts_) {
+            result = s->lower(b);
+        }
+        return result;
+    }
+
+    ir::Instr* Assign::lower(ir::Builder& b) {
+        ir::Instr* value = rexpr_.lower(b);
+        lexpr_.lower_store(b, value);
+        return value;
+    }
+
+    /* Each arm starts with the variables as they were before the 'if';
+     * where they come out different, the join gets phis.
+     */
+    ir::Instr* If::lower(ir::Builder& b) {
+        ir::BasicBlock* thenpart = b.new_block("then");
+        ir::BasicBlock* elsepart = b.new_block("else");
+        ir::BasicBlock* endpart = b.new_block("endif");
+        cond_.lower_branch(b, thenpart, elsepart);
+        ir::Builder::Env before = b.vars;
+        std::vector<ir::Builder::Env> envs;
+        std::vector<ir::Instr*> values;
+
+        b.set_block(thenpart);
+        values.push_back(truepart_.lower(b));
+        envs.push_back(b.vars);
+        b.jump(endpart);
+
+        b.vars = before;
+        b.set_block(elsepart);
+        values.push_back(falsepart_.lower(b));
+        envs.push_back(b.vars);
+        b.jump(endpart);
+
+        return b.join(endpart, envs, values);
+    }
+
+    /* The IR has no multiway branch, so a switch is a chain of
+     * tests again, but of a value we load only once.
+     */
+    ir::Instr* Switch::lower(ir::Builder& b) {
+        ir::Instr* value = var_.lower(b);
+        ir::BasicBlock* endpart = b.new_block("endswitch");
+        ir::Builder::Env before = b.vars;
+        std::vector<ir::Builder::Env> envs;
+        std::vector<ir::Instr*> values;
+        for (auto &c: cases_) {
+            ir::BasicBlock* casepart = b.new_block("case");
+            ir::BasicBlock* nextpart = b.new_block("next");
+            b.branch(b.binary(ir::Equals, value, b.constant(c.first)), casepart, nextpart);
+            b.set_block(casepart);
+            values.push_back(c.second->lower(b));
+            envs.push_back(b.vars);
+            b.jump(endpart);
+            b.vars = before;
+            b.set_block(nextpart);
+        }
+        values.push_back(default_.lower(b));
+        envs.push_back(b.vars);
+        b.jump(endpart);
+        return b.join(endpart, envs, values);
+    }
+
+    void Compare::lower_branch(ir::Builder& b, ir::BasicBlock* true_branch, ir::BasicBlock* false_branch) {
+        ir::Op op = c_compare_op_ == "<" ? ir::Less : c_compare_op_ == "<=" ? ir::AtMost
+                  : c_compare_op_ == ">" ? ir::Greater : c_compare_op_ == ">=" ? ir::AtLeast : ir::Equals;
+        ir::Instr* left = left_.lower(b);
+        ir::Instr* right = right_.lower(b);
+        b.branch(b.binary(op, left, right), true_branch, false_branch);
+    }
+
+    void And::lower_branch(ir::Builder& b, ir::BasicBlock* true_branch, ir::BasicBlock* false_branch) {
+        ir::BasicBlock* right_part = b.new_block("and");
+        left_.lower_branch(b, right_part, false_branch);
+        b.set_block(right_part);
+        right_.lower_branch(b, true_branch, false_branch);
+    }
+
+    void Or::lower_branch(ir::Builder& b, ir::BasicBlock* true_branch, ir::BasicBlock* false_branch) {
+        ir::BasicBlock* right_part = b.new_block("or");
+        left_.lower_branch(b, true_branch, right_part);
+        b.set_block(right_part);
+        right_.lower_branch(b, true_branch, false_branch);
+    }
+
+    void Not::lower_branch(ir::Builder& b, ir::BasicBlock* true_branch, ir::BasicBlock* false_branch) {
+        left_.lower_branch(b, false_branch, true_branch);
+    }
+
+    void AsBool::lower_branch(ir::Builder& b, ir::BasicBlock* true_branch, ir::BasicBlock* false_branch) {
+        b.branch(left_.lower(b), true_branch, false_branch);
+    }
+
+    ir::Instr* Plus::lower(ir::Builder& b) {
+        ir::Instr* left = left_.lower(b);
+        return b.binary(ir::Add, left, right_.lower(b));
+    }
+    ir::Instr* Minus::lower(ir::Builder& b) {
+        ir::Instr* left = left_.lower(b);
+        return b.binary(ir::Sub, left, right_.lower(b));
+    }
+    ir::Instr* Times::lower(ir::Builder& b) {
+        ir::Instr* left = left_.lower(b);
+        return b.binary(ir::Mul, left, right_.lower(b));
+    }
+    ir::Instr* Div::lower(ir::Builder& b) {
+        ir::Instr* left = left_.lower(b);
+        return b.binary(ir::Div, left, right_.lower(b));
+    }
+
+
     /* =================== Translation to C code (Compiler mode) ================ */
     void Block::gen_rvalue(CodegenContext& ctx, std::string target_reg) {
         for (auto &s: stmts_) {
@@ -98,27 +306,67 @@ namespace AST {
         std::string loc = lexpr_.gen_lvalue(ctx);
         rexpr_.gen_rvalue(ctx, target_reg);
         /* Store the value in the location */
-        ctx.emit(loc + "= " + target_reg + ";");
+        ctx.emit_store(loc, target_reg);
     }
 
     /* IF is a statement that executes either its true branch
      * or its false branch.  The value it places into the target
      * should be the value of whichever branch is taken.
      */
+    /* With a profile (parser -P), the arm that usually runs comes
+     * first, so that it is the fall-through, and jumps to each arm
+     * are marked likely or unlikely.
+     */
     void If::gen_rvalue(CodegenContext &ctx, std::string target_reg)  {
         std::string thenpart = ctx.new_branch_label("then");
         std::string elsepart = ctx.new_branch_label("else");
         std::string endpart = ctx.new_branch_label("endif");
+        int likely = ctx.profile ? ctx.profile->likely(this) : -1;
+        if (likely >= 0) {
+            ctx.hint_label(thenpart, likely == 1);
+            ctx.hint_label(elsepart, likely == 0);
+        }
         cond_.gen_branch(ctx, thenpart, elsepart);
-        /* Generate the 'then' part here */
-        ctx.emit(thenpart + ": ;");
-        truepart_.gen_rvalue(ctx, target_reg);
-        ctx.emit(std::string("goto ") + endpart + ";");
-        /* Generate the 'else' part here */
-        ctx.emit(elsepart + ": ;");
-        falsepart_.gen_rvalue(ctx, target_reg);
+        if (likely == 0) {
+            /* Usually false:  'else' part first */
+            ctx.emit_label(elsepart);
+            falsepart_.gen_rvalue(ctx, target_reg);
+            ctx.emit_jump(endpart);
+            ctx.emit_label(thenpart);
+            truepart_.gen_rvalue(ctx, target_reg);
+        } else {
+            /* Generate the 'then' part here */
+            ctx.emit_label(thenpart);
+            truepart_.gen_rvalue(ctx, target_reg);
+            ctx.emit_jump(endpart);
+            /* Generate the 'else' part here */
+            ctx.emit_label(elsepart);
+            falsepart_.gen_rvalue(ctx, target_reg);
+        }
         /* That's all, folks */
-        ctx.emit(endpart + ": ;");
+        ctx.emit_label(endpart);
+    }
+
+    /* Like IF, but the context picks the arm in one step */
+    void Switch::gen_rvalue(CodegenContext &ctx, std::string target_reg) {
+        std::string reg = ctx.alloc_reg();
+        var_.gen_rvalue(ctx, reg);
+        std::vector<std::pair<int, std::string>> labels;
+        for (auto &c: cases_) {
+            labels.push_back(std::make_pair(c.first, ctx.new_branch_label("case")));
+        }
+        std::string defaultpart = ctx.new_branch_label("default");
+        std::string endpart = ctx.new_branch_label("endswitch");
+        ctx.emit_switch(reg, labels, defaultpart);
+        ctx.free_reg(reg);
+        for (size_t i = 0; i < cases_.size(); ++i) {
+            ctx.emit_label(labels[i].second);
+            cases_[i].second->gen_rvalue(ctx, target_reg);
+            ctx.emit_jump(endpart);
+        }
+        ctx.emit_label(defaultpart);
+        default_.gen_rvalue(ctx, target_reg);
+        ctx.emit_label(endpart);
     }
 
     void Compare::gen_branch(CodegenContext &ctx, std::string true_branch, std::string false_branch) {
@@ -126,8 +374,8 @@ namespace AST {
         left_.gen_rvalue(ctx, left_reg);
         std::string right_reg = ctx.alloc_reg();
         right_.gen_rvalue(ctx, right_reg);
-        ctx.emit(std::string("if (") + left_reg + c_compare_op_ + right_reg + ") goto " + true_branch + ";");
-        ctx.emit(std::string("goto ") + false_branch + ";");
+        ctx.emit_compare_jump(left_reg, c_compare_op_, right_reg, true_branch);
+        ctx.emit_jump(false_branch);
         ctx.free_reg(left_reg);
         ctx.free_reg(right_reg);
     }
@@ -135,14 +383,14 @@ namespace AST {
     void And::gen_branch(CodegenContext &ctx, std::string true_branch, std::string false_branch) {
         std::string right_part = ctx.new_branch_label("and");
         left_.gen_branch(ctx, right_part, false_branch);
-        ctx.emit(right_part + ": ;");
+        ctx.emit_label(right_part);
         right_.gen_branch(ctx, true_branch, false_branch);
     }
 
     void Or::gen_branch(CodegenContext &ctx, std::string true_branch, std::string false_branch) {
         std::string right_part = ctx.new_branch_label("or");
-        left_.gen_branch(ctx, right_part, true_branch);
-        ctx.emit(right_part + ": ;");
+        left_.gen_branch(ctx, true_branch, right_part);
+        ctx.emit_label(right_part);
         right_.gen_branch(ctx, true_branch, false_branch);
     }
 
@@ -154,8 +402,8 @@ namespace AST {
         // At present, we don't have 'and' and 'or'
         std::string reg = ctx.alloc_reg();
         left_.gen_rvalue(ctx, reg);
-        ctx.emit(std::string("if (") + reg + ") goto " + true_branch + ";");
-        ctx.emit(std::string("goto ") + false_branch + ";");
+        ctx.emit_test_jump(reg, true_branch);
+        ctx.emit_jump(false_branch);
         ctx.free_reg(reg);
     }
 
@@ -179,15 +427,14 @@ namespace AST {
         /* In assembly language we would generate a LOAD instruction;
          * in C we generate an assignment.
          */
-        ctx.emit(target_reg + " = " + loc + "; // LOAD");
+        ctx.emit_load(target_reg, loc);
     }
 
     /* Constants have rvalues but not lvalues, because you should
      * really not change the values of your constants.
      */
     void IntConst::gen_rvalue(CodegenContext &ctx, std::string target_reg) {
-        ctx.emit(target_reg + " = " + std::to_string(value_)
-            + "; // LOAD constant value");
+        ctx.emit_load_const(target_reg, value_);
     }
 
     /* Binary operators */
@@ -196,8 +443,7 @@ namespace AST {
         left_.gen_rvalue(ctx, target_reg);
         std::string right_reg = ctx.alloc_reg();
         right_.gen_rvalue(ctx, right_reg);
-        ctx.emit(target_reg + " = (" + target_reg + ") + ("
-             + right_reg + "); // Plus");
+        ctx.emit_arith(target_reg, '+', right_reg);
         ctx.free_reg(right_reg);
     }
 
@@ -205,8 +451,7 @@ namespace AST {
         left_.gen_rvalue(ctx, target_reg);
         std::string right_reg = ctx.alloc_reg();
         right_.gen_rvalue(ctx, right_reg);
-        ctx.emit(target_reg + " = (" + target_reg + ") - ("
-                 + right_reg + "); // Minus");
+        ctx.emit_arith(target_reg, '-', right_reg);
         ctx.free_reg(right_reg);
     }
 
@@ -214,8 +459,7 @@ namespace AST {
         left_.gen_rvalue(ctx, target_reg);
         std::string right_reg = ctx.alloc_reg();
         right_.gen_rvalue(ctx, right_reg);
-        ctx.emit(target_reg + " = (" + target_reg + ") * ("
-                 + right_reg + "); // Times");
+        ctx.emit_arith(target_reg, '*', right_reg);
         ctx.free_reg(right_reg);
     }
 
@@ -223,11 +467,106 @@ namespace AST {
         left_.gen_rvalue(ctx, target_reg);
         std::string right_reg = ctx.alloc_reg();
         right_.gen_rvalue(ctx, right_reg);
-        ctx.emit(target_reg + " = (" + target_reg + ") / ("
-                 + right_reg + "); // Div");
+        ctx.emit_arith(target_reg, '/', right_reg);
         ctx.free_reg(right_reg);
     }
 
+    /* ============ Translation to structured C (parser -C) ============ */
+
+    // Only the last statement's value can become the value of
+    // the block, so the others don't need to store it anywhere.
+    // The value of an empty block is zero, as in eval.
+    void Block::gen_structured(StructuredCodegenContext& ctx, std::string target) {
+        if (stmts_.empty()) {
+            if (! target.empty()) { ctx.emit(target + " = 0;"); }
+            return;
+        }
+        for (size_t i = 0; i < stmts_.size(); ++i) {
+            stmts_[i]->gen_structured(ctx, i + 1 == stmts_.size() ? target : "");
+        }
+    }
+
+    void Assign::gen_structured(StructuredCodegenContext& ctx, std::string target) {
+        std::string loc = lexpr_.c_expr(ctx);
+        ctx.emit(loc + " = " + rexpr_.c_expr(ctx) + ";");
+        if (! target.empty()) {
+            ctx.emit(target + " = " + loc + ";");
+        }
+    }
+
+    // An else part that is nothing but another 'if' (as from elif)
+    // becomes 'else if', rather than nesting deeper and deeper.
+    void If::gen_structured(StructuredCodegenContext& ctx, std::string target) {
+        ctx.open("if (" + cond_.c_expr(ctx) + ")");
+        truepart_.gen_structured(ctx, target);
+        If* chain = this;
+        while (chain->falsepart_.stmts().size() == 1) {
+            If* next = dynamic_cast<If*>(chain->falsepart_.stmts()[0]);
+            if (next == nullptr) { break; }
+            chain = next;
+            ctx.reopen("else if (" + chain->cond_.c_expr(ctx) + ")");
+            chain->truepart_.gen_structured(ctx, target);
+        }
+        if (! (chain->falsepart_.stmts().empty() && target.empty())) {
+            ctx.reopen("else");
+            chain->falsepart_.gen_structured(ctx, target);
+        }
+        ctx.close();
+    }
+
+    void Switch::gen_structured(StructuredCodegenContext& ctx, std::string target) {
+        ctx.open("switch (" + var_.c_expr(ctx, 0) + ")");
+        for (auto &c: cases_) {
+            ctx.open("case " + std::to_string(c.first) + ":");
+            c.second->gen_structured(ctx, target);
+            ctx.emit("break;");
+            ctx.close();
+        }
+        ctx.open("default:");
+        default_.gen_structured(ctx, target);
+        ctx.close();
+        ctx.close();
+    }
+
+    std::string IntConst::c_expr(StructuredCodegenContext& ctx, int c_prec) {
+        if (value_ >= 0) { return std::to_string(value_); }
+        if (value_ == INT_MIN) { return "(-2147483647 - 1)"; }
+        return "(" + std::to_string(value_) + ")";
+    }
+
+    // C operator and precedence for each kind of binary operator
+    static const std::map<std::string, std::pair<const char*, int>> c_operators = {
+            {"Or", {"||", 1}}, {"And", {"&&", 2}},
+            {"Equals", {"==", 3}},
+            {"Less", {"<", 4}}, {"AtMost", {"<=", 4}}, {"Greater", {">", 4}}, {"AtLeast", {">=", 4}},
+            {"Plus", {"+", 5}}, {"Minus", {"-", 5}},
+            {"Times", {"*", 6}}, {"Div", {"/", 6}}
+    };
+    static const int c_prec_unary = 7;
+
+    /* Parenthesize only where C precedence requires it.  The operators
+     * are left associative, so a - (b - c) needs its parentheses but
+     * (a - b) - c does not.  Comparisons don't associate in the
+     * calculator, so both sides get parentheses if they need any.
+     */
+    std::string BinOp::c_expr(StructuredCodegenContext& ctx, int c_prec) {
+        auto op = c_operators.at(opsym);
+        if (opsym == "Div" && ctx.forced_division) {
+            return "(volatile int){(volatile int){" + left_.c_expr(ctx)
+                    + "} / (volatile int){" + right_.c_expr(ctx) + "}}";
+        }
+        int prec = op.second;
+        bool compare = (prec == 3 || prec == 4);
+        std::string text = left_.c_expr(ctx, compare ? prec + 1 : prec)
+                + " " + op.first + " " + right_.c_expr(ctx, prec + 1);
+        return prec < c_prec ? "(" + text + ")" : text;
+    }
+
+    std::string Not::c_expr(StructuredCodegenContext& ctx, int c_prec) {
+        return "!" + left_.c_expr(ctx, c_prec_unary + 1);
+    }
+
+
     /* ========================================== */
 
     // JSON representation of all the concrete node types.
@@ -251,6 +590,9 @@ namespace AST {
     void ASTNode::json_head(std::string node_kind, std::ostream& out, AST_print_context& ctx) {
         json_indent(out, ctx);
         out << "{ \"kind\" : \"" << node_kind << "\"," ;
+        if (ctx.profile_) {
+            out << "\"hits_\" : " << ctx.profile_->counts(this).hits << ",";
+        }
         ctx.indent();  // one level more for children
         return;
     }
@@ -293,21 +635,46 @@ namespace AST {
 
     void If::json(std::ostream& out, AST_print_context& ctx) {
         json_head("If", out, ctx);
+        if (ctx.profile_) {
+            Profile::Counts counts = ctx.profile_->counts(this);
+            out << "\"taken_\" : " << counts.taken << ",\"not_taken_\" : " << counts.not_taken << ",";
+        }
         json_child("cond_", cond_, out, ctx);
         json_child("truepart_", truepart_, out, ctx);
         json_child("falsepart_", falsepart_, out, ctx, ' ');
         json_close(out, ctx);
     }
 
+    void Switch::json(std::ostream& out, AST_print_context& ctx) {
+        json_head("Switch", out, ctx);
+        json_child("var_", var_, out, ctx);
+        json_indent(out, ctx);
+        out << "\"cases_\" : [";
+        auto sep = "";
+        for (auto &c: cases_) {
+            out << sep;
+            json_indent(out, ctx);
+            out << "{ \"kind\" : \"Case\",\"value_\" : " << c.first << ",";
+            ctx.indent();
+            json_child("body_", *c.second, out, ctx, ' ');
+            out << "}";
+            ctx.dedent();
+            sep = ", ";
+        }
+        out << "],";
+        json_child("default_", default_, out, ctx, ' ');
+        json_close(out, ctx);
+    }
+
     void Not::json(std::ostream& out, AST_print_context& ctx) {
         json_head("Not", out, ctx);
-        json_child("left_", left_, out, ctx);
+        json_child("left_", left_, out, ctx, ' ');
         json_close(out, ctx);
     }
 
     void AsBool::json(std::ostream& out, AST_print_context& ctx) {
         json_head("AsBool", out, ctx);
-        json_child("left_", left_, out, ctx);
+        json_child("left_", left_, out, ctx, ' ');
         json_close(out, ctx);
     }
 
@@ -330,4 +697,198 @@ namespace AST {
         json_close(out, ctx);
     }
 
-}
\ No newline at end of file
+
+    /* ============ Partial evaluation (parser -D) ============ */
+
+    void ASTNode::specialize(PartialEval& pe) {
+        pe.emit(residual(pe));
+    }
+
+    void Assign::specialize(PartialEval& pe) {
+        pe.assign(dynamic_cast<Ident&>(lexpr_), rexpr_.residual(pe));
+    }
+
+    void If::specialize(PartialEval& pe) {
+        ASTNode* cond = cond_.residual(pe);
+        if (IntConst* known = dynamic_cast<IntConst*>(cond)) {
+            pe.splice(known->value() ? truepart_ : falsepart_);
+            return;
+        }
+        std::vector<Block*> arms = pe.arms({&truepart_, &falsepart_});
+        pe.emit(new If(*cond, *arms[0], *arms[1]));
+    }
+
+    void Switch::specialize(PartialEval& pe) {
+        int value;
+        if (pe.known(var_.name(), value)) {
+            pe.splice(*arm(value));
+            return;
+        }
+        std::vector<Block*> blocks;
+        for (auto& c : cases_) { blocks.push_back(c.second); }
+        blocks.push_back(&default_);
+        std::vector<Block*> arms = pe.arms(blocks);
+        std::vector<std::pair<int, Block*>> cases;
+        for (size_t i = 0; i < cases_.size(); ++i) {
+            cases.push_back(std::make_pair(cases_[i].first, arms[i]));
+        }
+        pe.emit(new Switch(var_, cases, *arms.back()));
+    }
+
+    ASTNode* Ident::residual(PartialEval& pe) {
+        int value;
+        if (pe.known(text_, value)) { return new IntConst(value); }
+        return this;
+    }
+
+    // When the operands are known, the value is whatever eval says,
+    // so that the residual program computes what the original would.
+    static ASTNode* fold(ASTNode* node) {
+        EvalContext ctx;
+        return new IntConst(node->eval(ctx));
+    }
+
+    ASTNode* BinOp::residual_of(ASTNode* l, ASTNode* r) {
+        BinOp* node = (l == &left_ && r == &right_) ? this : rebuild(*l, *r);
+        IntConst* kl = dynamic_cast<IntConst*>(l);
+        IntConst* kr = dynamic_cast<IntConst*>(r);
+        if (kl == nullptr || kr == nullptr) { return node; }
+        // Division that would trap is left to trap at run time, if it's reached
+        if (opsym == "Div" && (kr->value() == 0 || (kl->value() == INT_MIN && kr->value() == -1))) {
+            return node;
+        }
+        return fold(node);
+    }
+
+    ASTNode* BinOp::residual(PartialEval& pe) {
+        ASTNode* l = left_.residual(pe);
+        return residual_of(l, right_.residual(pe));
+    }
+
+    // Conditions are only ever tested for truth, so a known operand of
+    // 'and' or 'or' either decides it or can be left out.  If the left
+    // operand decides it, the right is never evaluated.  A known right
+    // operand that doesn't decide it still needs a branch of its own.
+    ASTNode* And::residual(PartialEval& pe) {
+        ASTNode* l = left_.residual(pe);
+        if (IntConst* known = dynamic_cast<IntConst*>(l)) {
+            return known->value() ? right_.residual(pe) : new IntConst(0);
+        }
+        ASTNode* r = right_.residual(pe);
+        if (IntConst* known = dynamic_cast<IntConst*>(r)) {
+            if (known->value()) { return l; }
+            r = new AsBool(*r);
+        }
+        return residual_of(l, r);
+    }
+
+    ASTNode* Or::residual(PartialEval& pe) {
+        ASTNode* l = left_.residual(pe);
+        if (IntConst* known = dynamic_cast<IntConst*>(l)) {
+            return known->value() ? new IntConst(1) : right_.residual(pe);
+        }
+        ASTNode* r = right_.residual(pe);
+        if (IntConst* known = dynamic_cast<IntConst*>(r)) {
+            if (! known->value()) { return l; }
+            r = new AsBool(*r);
+        }
+        return residual_of(l, r);
+    }
+
+    ASTNode* Not::residual(PartialEval& pe) {
+        ASTNode* l = left_.residual(pe);
+        ASTNode* node = l == &left_ ? this : new Not(*l);
+        return dynamic_cast<IntConst*>(l) ? fold(node) : node;
+    }
+
+    ASTNode* AsBool::residual(PartialEval& pe) {
+        ASTNode* l = left_.residual(pe);
+        ASTNode* node = l == &left_ ? this : new AsBool(*l);
+        return dynamic_cast<IntConst*>(l) ? fold(node) : node;
+    }
+
+    /* ============ Recognizing switches (parser -m) ============ */
+
+    // Shorter chains are as quick to test one condition at a time
+    static const size_t min_switch_cases = 3;
+
+    bool Equals::case_test(std::string& var, int& value) {
+        Ident* ident = dynamic_cast<Ident*>(&left_);
+        IntConst* constant = dynamic_cast<IntConst*>(&right_);
+        if (ident == nullptr) {
+            ident = dynamic_cast<Ident*>(&right_);
+            constant = dynamic_cast<IntConst*>(&left_);
+        }
+        if (ident == nullptr || constant == nullptr) { return false; }
+        var = ident->name();
+        value = constant->value();
+        return true;
+    }
+
+    /* Follow the chain of 'elif's as long as each tests the same
+     * variable against a constant.  The first that doesn't, with
+     * everything after it, becomes the default.  Conditions have no
+     * side effects and the variable can't change between them, so
+     * this is the same as testing them in order, provided that when
+     * a value comes up again, we keep the first arm for it.
+     */
+    Switch* If::as_switch() {
+        std::string var;
+        int value;
+        if (! cond_.case_test(var, value)) { return nullptr; }
+        std::vector<std::pair<int, Block*>> cases;
+        std::set<int> seen;
+        If* arm = this;
+        for (;;) {
+            if (seen.insert(value).second) {
+                cases.push_back(std::make_pair(value, &arm->truepart_));
+            }
+            const std::vector<ASTNode*>& rest = arm->falsepart_.stmts();
+            If* next = rest.size() == 1 ? dynamic_cast<If*>(rest[0]) : nullptr;
+            std::string next_var;
+            if (next == nullptr || ! next->cond_.case_test(next_var, value) || next_var != var) {
+                break;
+            }
+            arm = next;
+        }
+        if (cases.size() < min_switch_cases) { return nullptr; }
+        return new Switch(*new Ident(var), cases, arm->falsepart_);
+    }
+
+    bool may_trap(ASTNode* expr) {
+        std::vector<ASTNode*> kids;
+        expr->children(kids);
+        if (dynamic_cast<Div*>(expr) != nullptr) {
+            IntConst* dividend = dynamic_cast<IntConst*>(kids[0]);
+            IntConst* divisor = dynamic_cast<IntConst*>(kids[1]);
+            if (divisor == nullptr || divisor->value() == 0) { return true; }
+            if (divisor->value() == -1 && (dividend == nullptr || dividend->value() == INT_MIN)) {
+                return true;
+            }
+        }
+        for (ASTNode* kid : kids) {
+            if (may_trap(kid)) { return true; }
+        }
+        return false;
+    }
+
+    void make_switches(ASTNode& root) {
+        std::vector<ASTNode*> work{&root};
+        std::vector<ASTNode*> kids;
+        while (! work.empty()) {
+            ASTNode* node = work.back();
+            work.pop_back();
+            if (Block* block = dynamic_cast<Block*>(node)) {
+                for (size_t i = 0; i < block->stmts().size(); ++i) {
+                    If* chain = dynamic_cast<If*>(block->stmts()[i]);
+                    Switch* multiway = chain ? chain->as_switch() : nullptr;
+                    if (multiway) { block->replace(i, multiway); }
+                }
+            }
+            kids.clear();
+            node->children(kids);
+            work.insert(work.end(), kids.begin(), kids.end());
+        }
+    }
+
+}
@@ -8,10 +8,16 @@
 #include <string>
 #include <sstream>
 #include <vector>
+#include <set>
+#include <unordered_map>
 #include <iostream>
 #include <assert.h>
 #include "CodegenContext.h"
+#include "StructuredCodegenContext.h"
 #include "EvalContext.h"
+#include "Profile.h"
+#include "Governor.h"
+#include "IR.h"
 
 namespace AST {
     // Abstract syntax tree.  ASTNode is abstract base class for all other nodes.
@@ -21,15 +27,92 @@ namespace AST {
     class AST_print_context {
     public:
         int indent_; // Number of spaces to place on left, after each newline
-        AST_print_context() : indent_{0} {};
+        const Profile* profile_;  // If we have one, counts go in the output too
+        AST_print_context() : indent_{0}, profile_{nullptr} {};
         void indent() { ++indent_; }
         void dedent() { --indent_; }
     };
 
 
+    // Dependence analysis collects the variables a subtree reads and
+    // the variables it might assign (in an 'if', only one arm is executed,
+    // so a variable in 'writes' is not necessarily written).
+    class VarUse {
+    public:
+        std::set<std::string> reads;
+        std::set<std::string> writes;
+    };
+
+    class Block;
+    class ASTNode;
+    class Switch;
+    class PartialEval;
+
+    /* Could evaluating this expression trap?  Only a division can:  by
+     * a divisor that isn't a known constant, by 0, or by -1 unless the
+     * dividend is a known constant other than INT_MIN.  An expression
+     * whose value isn't used may be dropped only if it can't.
+     */
+    bool may_trap(ASTNode* expr);
+
+    /* Owns every node built on this thread while it is in use, and
+     * deletes them all together.  Nodes don't delete their children,
+     * so this is how a long-running parser (parser -S) throws away a
+     * program it no longer needs, including nodes that error recovery
+     * left out of the tree.  Outside of any arena, nodes are never freed.
+     */
+    class NodeArena {
+        std::vector<ASTNode*> nodes_;
+        static thread_local NodeArena* current_;
+    public:
+        NodeArena() {}
+        NodeArena(const NodeArena&) = delete;
+        NodeArena& operator=(const NodeArena&) = delete;
+        ~NodeArena() { clear(); }
+        void clear();
+        size_t size() const { return nodes_.size(); }
+        static void adopt(ASTNode* node) { if (current_) current_->nodes_.push_back(node); }
+
+        /* Nodes built while a Use is in scope belong to the arena */
+        class Use {
+            NodeArena* saved_;
+        public:
+            explicit Use(NodeArena& arena) : saved_{current_} { current_ = &arena; }
+            ~Use() { current_ = saved_; }
+        };
+    };
+
     class ASTNode {
     public:
-        virtual int eval(EvalContext &ctx) = 0;        // Immediate evaluation
+        // The arena must not take a node whose construction is abandoned
+        ASTNode() { governor::charge_node(); NodeArena::adopt(this); }
+        virtual ~ASTNode() {}
+        /* Immediate evaluation.  Each kind of node evaluates itself in
+         * eval_node; eval is the way in, so that the profiler (parser -p)
+         * can count every node that is evaluated.
+         */
+        int eval(EvalContext &ctx) {
+            if (ctx.profile) { ctx.profile->hit(this); }
+            governor::tick();
+            return eval_node(ctx);
+        }
+        virtual int eval_node(EvalContext &ctx) = 0;
+        virtual void uses(VarUse& use) = 0;            // Dependence analysis
+
+        /* The immediate subtrees, in the order json prints them */
+        virtual void children(std::vector<ASTNode*>& kids) { }
+
+        /* Is this a test of a variable against a constant, like x == 3?
+         * If so, which variable and which constant.
+         */
+        virtual bool case_test(std::string& var, int& value) { return false; }
+
+        /* A statement that executes one of several blocks (like 'if')
+         * can evaluate just its choice and return the chosen block,
+         * so that the caller can evaluate the block its own way
+         * (e.g., in parallel).  Returns nullptr for other statements.
+         */
+        virtual Block* select(EvalContext& ctx) { return nullptr; }
 
         /* Code generation: Of an lvalue, of an rvalue, and of a branch */
         /* Each subtree may implement some of these and not others, so the default
@@ -54,6 +137,53 @@ namespace AST {
             assert(false);
         }
 
+        /* Structured C (parser -C):  A statement, leaving its value in target
+         * unless target is empty, and an expression as nested C.  Every
+         * expression is also a statement, so only statements that
+         * aren't expressions need to override gen_structured.  An
+         * unused expression is still emitted if it might trap.
+         * c_prec is the precedence of the surrounding C operator,
+         * to decide whether we need parentheses.
+         */
+        virtual void gen_structured(StructuredCodegenContext& ctx, std::string target) {
+            if (! target.empty()) {
+                ctx.emit(target + " = " + c_expr(ctx) + ";");
+            } else if (may_trap(this)) {
+                ctx.forced_division = true;
+                ctx.emit("(void)(" + c_expr(ctx) + ");");
+                ctx.forced_division = false;
+            }
+        }
+        virtual std::string c_expr(StructuredCodegenContext& ctx, int c_prec = 0) {
+            std::cerr << "*** No C expression for this node ***" << std::endl;
+            assert(false);
+        }
+
+        /* Lowering to the SSA intermediate representation, again as
+         * a value or as a branch.  Errors by default, like code generation.
+         */
+        virtual ir::Instr* lower(ir::Builder& b) {
+            std::cerr << "*** No IR value for this node ***" << std::endl;
+            assert(false);
+        }
+        virtual void lower_branch(ir::Builder& b, ir::BasicBlock* true_branch, ir::BasicBlock* false_branch) {
+            std::cerr << "*** No IR branching on this node ***" << std::endl;
+            assert(false);
+        }
+
+        /* Partial evaluation (parser -D):  residual is an expression
+         * that computes what this one does, given the variables pe
+         * knows (an IntConst if that's all it takes).  specialize adds
+         * what a statement still has to do to pe's residual program.
+         * Every expression is also a statement, so only statements
+         * that aren't expressions need to override specialize.
+         */
+        virtual ASTNode* residual(PartialEval& pe) {
+            std::cerr << "*** No residual for this node ***" << std::endl;
+            assert(false);
+        }
+        virtual void specialize(PartialEval& pe);
+
         /* Dump JSON representation */
         virtual void json(std::ostream& out, AST_print_context& ctx) = 0;
 
@@ -79,7 +209,13 @@ namespace AST {
     public:
         explicit Block() : stmts_{std::vector<ASTNode*>()} {}
         void append(ASTNode* stmt) { stmts_.push_back(stmt); }
-        int eval(EvalContext& ctx) override;
+        void replace(size_t i, ASTNode* stmt) { stmts_[i] = stmt; }
+        const std::vector<ASTNode*>& stmts() const { return stmts_; }
+        void children(std::vector<ASTNode*>& kids) override { kids.insert(kids.end(), stmts_.begin(), stmts_.end()); }
+        int eval_node(EvalContext& ctx) override;
+        void uses(VarUse& use) override;
+        ir::Instr* lower(ir::Builder& b) override;
+        void gen_structured(StructuredCodegenContext& ctx, std::string target) override;
         void gen_rvalue(CodegenContext& ctx, std::string target_reg) override;
         void json(std::ostream& out, AST_print_context& ctx) override;
      };
@@ -102,6 +238,8 @@ namespace AST {
     class LExpr : public ASTNode {
     public:
         virtual std::string l_eval(EvalContext& ctx) = 0;
+        virtual void l_uses(VarUse& use) = 0;  // Location, not value, is used
+        virtual void lower_store(ir::Builder& b, ir::Instr* value) = 0;
     };
 
     /* An assignment has an lvalue (location to be assigned to)
@@ -115,9 +253,14 @@ namespace AST {
     public:
         Assign(LExpr &lexpr, ASTNode &rexpr) :
            lexpr_{lexpr}, rexpr_{rexpr} {};
+        void children(std::vector<ASTNode*>& kids) override { kids.push_back(&lexpr_); kids.push_back(&rexpr_); }
         void gen_rvalue(CodegenContext& ctx, std::string target_reg) override;
         void json(std::ostream& out, AST_print_context& ctx) override;
-        int eval(EvalContext& ctx) override;
+        int eval_node(EvalContext& ctx) override;
+        void uses(VarUse& use) override;
+        ir::Instr* lower(ir::Builder& b) override;
+        void gen_structured(StructuredCodegenContext& ctx, std::string target) override;
+        void specialize(PartialEval& pe) override;
         void r_eval(CodegenContext& ctx, std::string target_reg);
     };
 
@@ -128,9 +271,18 @@ namespace AST {
     public:
         explicit If(ASTNode &cond, Block &truepart, Block &falsepart) :
             cond_{cond}, truepart_{truepart}, falsepart_{falsepart} { };
+        void children(std::vector<ASTNode*>& kids) override {
+            kids.push_back(&cond_); kids.push_back(&truepart_); kids.push_back(&falsepart_);
+        }
         void gen_rvalue(CodegenContext& ctx, std::string target_reg) override;
         void json(std::ostream& out, AST_print_context& ctx) override;
-        int eval(EvalContext& ctx) override;
+        int eval_node(EvalContext& ctx) override;
+        void uses(VarUse& use) override;
+        Block* select(EvalContext& ctx) override;
+        ir::Instr* lower(ir::Builder& b) override;
+        void gen_structured(StructuredCodegenContext& ctx, std::string target) override;
+        void specialize(PartialEval& pe) override;
+        Switch* as_switch();
     };
 
     /* We need a node to represent interpretation of an r-expression
@@ -142,10 +294,15 @@ namespace AST {
         ASTNode &left_;
     public:
         explicit AsBool(ASTNode &left) : left_{left} {}
+        void children(std::vector<ASTNode*>& kids) override { kids.push_back(&left_); }
         void gen_branch(CodegenContext& ctx,
                 std::string true_branch, std::string false_branch) override;
         void json(std::ostream& out, AST_print_context& ctx) override;
-        int eval(EvalContext& ctx) override;
+        int eval_node(EvalContext& ctx) override;
+        void uses(VarUse& use) override { left_.uses(use); }
+        void lower_branch(ir::Builder& b, ir::BasicBlock* true_branch, ir::BasicBlock* false_branch) override;
+        std::string c_expr(StructuredCodegenContext& ctx, int c_prec) override { return left_.c_expr(ctx, c_prec); }
+        ASTNode* residual(PartialEval& pe) override;
     };
 
     /* Identifiers like x and literals like 42 are the
@@ -158,20 +315,32 @@ namespace AST {
         std::string text_;
     public:
         explicit Ident(std::string txt) : text_{txt} {}
+        const std::string& name() const { return text_; }
         void gen_rvalue(CodegenContext& ctx, std::string target_reg) override;
         std::string gen_lvalue(CodegenContext& ctx) override;
         void json(std::ostream& out, AST_print_context& ctx) override;
-        int eval(EvalContext &ctx) override;
+        int eval_node(EvalContext &ctx) override;
         std::string l_eval(EvalContext& ctx) override { return text_; }
+        void uses(VarUse& use) override { use.reads.insert(text_); }
+        void l_uses(VarUse& use) override { use.writes.insert(text_); }
+        ir::Instr* lower(ir::Builder& b) override { return b.read(text_); }
+        void lower_store(ir::Builder& b, ir::Instr* value) override { b.write(text_, value); }
+        std::string c_expr(StructuredCodegenContext& ctx, int c_prec) override { return ctx.get_local_var(text_); }
+        ASTNode* residual(PartialEval& pe) override;
     };
 
     class IntConst : public ASTNode {
         int value_;
     public:
         explicit IntConst(int v) : value_{v} {}
+        int value() const { return value_; }
         void gen_rvalue(CodegenContext& ctx, std::string target_reg) override;
         void json(std::ostream& out, AST_print_context& ctx) override;
-        int eval(EvalContext &ctx) override { return value_; }
+        int eval_node(EvalContext &ctx) override { return value_; }
+        void uses(VarUse& use) override { }
+        ir::Instr* lower(ir::Builder& b) override { return b.constant(value_); }
+        std::string c_expr(StructuredCodegenContext& ctx, int c_prec) override;
+        ASTNode* residual(PartialEval& pe) override { return this; }
     };
 
     // Virtual base class for +, -, *, /, etc
@@ -185,38 +354,53 @@ namespace AST {
         ASTNode &right_;
         BinOp(std::string sym, ASTNode &l, ASTNode &r) :
                 opsym{sym}, left_{l}, right_{r} {};
+        ASTNode* residual_of(ASTNode* l, ASTNode* r);
     public:
+        /* The same operation on other operands */
+        virtual BinOp* rebuild(ASTNode& l, ASTNode& r) = 0;
+        ASTNode* residual(PartialEval& pe) override;
         void json(std::ostream& out, AST_print_context& ctx) override;
+        void uses(VarUse& use) override { left_.uses(use); right_.uses(use); }
+        void children(std::vector<ASTNode*>& kids) override { kids.push_back(&left_); kids.push_back(&right_); }
+        std::string c_expr(StructuredCodegenContext& ctx, int c_prec) override;
     };
 
     class Plus : public BinOp {
     public:
+        BinOp* rebuild(ASTNode& l, ASTNode& r) override { return new Plus(l, r); }
         void gen_rvalue(CodegenContext& ctx, std::string target_reg) override;
-        int eval(EvalContext& ctx) override;
+        ir::Instr* lower(ir::Builder& b) override;
+        int eval_node(EvalContext& ctx) override;
         Plus(ASTNode &l, ASTNode &r) :
                 BinOp(std::string("Plus"),  l, r) {};
     };
 
     class Minus : public BinOp {
     public:
+        BinOp* rebuild(ASTNode& l, ASTNode& r) override { return new Minus(l, r); }
         void gen_rvalue(CodegenContext& ctx, std::string target_reg) override;
-        int eval(EvalContext& ctx) override;
+        ir::Instr* lower(ir::Builder& b) override;
+        int eval_node(EvalContext& ctx) override;
         Minus(ASTNode &l, ASTNode &r) :
             BinOp(std::string("Minus"),  l, r) {};
     };
 
     class Times : public BinOp {
     public:
+        BinOp* rebuild(ASTNode& l, ASTNode& r) override { return new Times(l, r); }
         void gen_rvalue(CodegenContext& ctx, std::string target_reg) override;
-        int eval(EvalContext& ctx) override;
+        ir::Instr* lower(ir::Builder& b) override;
+        int eval_node(EvalContext& ctx) override;
         Times(ASTNode &l, ASTNode &r) :
                 BinOp(std::string("Times"),  l, r) {};
     };
 
     class Div : public BinOp {
     public:
+        BinOp* rebuild(ASTNode& l, ASTNode& r) override { return new Div(l, r); }
         void gen_rvalue(CodegenContext& ctx, std::string target_reg) override;
-        int eval(EvalContext& ctx) override;
+        ir::Instr* lower(ir::Builder& b) override;
+        int eval_node(EvalContext& ctx) override;
         Div (ASTNode &l, ASTNode &r) :
                 BinOp(std::string("Div"),  l, r) {};
     };
@@ -226,16 +410,22 @@ namespace AST {
     // gen_branch method for each.
     class And : public BinOp {
     public:
+        BinOp* rebuild(ASTNode& l, ASTNode& r) override { return new And(l, r); }
         void gen_branch(CodegenContext& ctx, std::string true_branch, std::string false_branch) override;
-        int eval(EvalContext& ctx) override;
+        void lower_branch(ir::Builder& b, ir::BasicBlock* true_branch, ir::BasicBlock* false_branch) override;
+        int eval_node(EvalContext& ctx) override;
+        ASTNode* residual(PartialEval& pe) override;
         And (ASTNode &l, ASTNode &r) :
                 BinOp(std::string("And"),  l, r) {};
     };
 
     class Or : public BinOp {
     public:
+        BinOp* rebuild(ASTNode& l, ASTNode& r) override { return new Or(l, r); }
         void gen_branch(CodegenContext& ctx, std::string true_branch, std::string false_branch) override;
-        int eval(EvalContext& ctx) override;
+        void lower_branch(ir::Builder& b, ir::BasicBlock* true_branch, ir::BasicBlock* false_branch) override;
+        int eval_node(EvalContext& ctx) override;
+        ASTNode* residual(PartialEval& pe) override;
         Or (ASTNode &l, ASTNode &r) :
                 BinOp(std::string("Or"),  l, r) {};
     };
@@ -244,9 +434,14 @@ namespace AST {
         ASTNode& left_;
     public:
         explicit Not(ASTNode &l) : left_{l} {}
+        void children(std::vector<ASTNode*>& kids) override { kids.push_back(&left_); }
         void gen_branch(CodegenContext& ctx, std::string true_branch, std::string false_branch) override;
-        int eval(EvalContext& ctx) override;
+        void lower_branch(ir::Builder& b, ir::BasicBlock* true_branch, ir::BasicBlock* false_branch) override;
+        int eval_node(EvalContext& ctx) override;
         void json(std::ostream& out, AST_print_context& ctx) override;
+        void uses(VarUse& use) override { left_.uses(use); }
+        std::string c_expr(StructuredCodegenContext& ctx, int c_prec) override;
+        ASTNode* residual(PartialEval& pe) override;
     };
 
 
@@ -259,43 +454,84 @@ namespace AST {
         Compare(std::string sym,  std::string op, ASTNode &l, ASTNode &r) :
             BinOp(sym, l, r), c_compare_op_{op} {};
         void gen_branch(CodegenContext& ctx, std::string true_branch, std::string false_branch) override;
+        void lower_branch(ir::Builder& b, ir::BasicBlock* true_branch, ir::BasicBlock* false_branch) override;
     };
 
     class Less : public Compare {
     public:
+        BinOp* rebuild(ASTNode& l, ASTNode& r) override { return new Less(l, r); }
         Less (ASTNode &l, ASTNode &r) :
             Compare("Less", "<",  l, r) {};
-        int eval(EvalContext& ctx) override;
+        int eval_node(EvalContext& ctx) override;
     };
 
     class AtMost : public Compare {
     public:
+        BinOp* rebuild(ASTNode& l, ASTNode& r) override { return new AtMost(l, r); }
         AtMost (ASTNode &l, ASTNode &r) :
                 Compare("AtMost", "<=",  l, r) {};
-        int eval(EvalContext& ctx) override;
+        int eval_node(EvalContext& ctx) override;
     };
 
     class AtLeast : public Compare {
     public:
+        BinOp* rebuild(ASTNode& l, ASTNode& r) override { return new AtLeast(l, r); }
         AtLeast (ASTNode &l, ASTNode &r) :
                 Compare("AtLeast", ">=",  l, r) {};
-        int eval(EvalContext& ctx) override;
+        int eval_node(EvalContext& ctx) override;
     };
 
     class Greater : public Compare {
     public:
+        BinOp* rebuild(ASTNode& l, ASTNode& r) override { return new Greater(l, r); }
         Greater (ASTNode &l, ASTNode &r) :
-                Compare("Less", "<", l, r) {};
-        int eval(EvalContext& ctx) override;
+                Compare("Greater", ">", l, r) {};
+        int eval_node(EvalContext& ctx) override;
     };
 
     class Equals : public Compare {
     public:
+        BinOp* rebuild(ASTNode& l, ASTNode& r) override { return new Equals(l, r); }
         Equals (ASTNode &l, ASTNode &r) :
                 Compare("Equals", "==", l, r) {};
-        int eval(EvalContext& ctx) override;
+        int eval_node(EvalContext& ctx) override;
+        bool case_test(std::string& var, int& value) override;
+    };
+
+    /* A multiway branch on the value of a variable.  The parser never
+     * builds one; If::as_switch makes one from a chain like
+     *     if x == 1 then .. elif x == 2 then .. elif x == 7 then .. else .. fi
+     * which would otherwise test the conditions one at a time.  Eval
+     * finds the arm in one step, with a table indexed by value if the
+     * values are close together and a hash table otherwise.  Each
+     * value appears only once; the default is the 'else' part.
+     */
+    class Switch : public ASTNode {
+        Ident &var_;
+        std::vector<std::pair<int, Block*>> cases_;  // In source order
+        Block &default_;
+        int table_base_;
+        std::vector<Block*> table_;                  // Dense:  arm for table_base_ + i
+        std::unordered_map<int, Block*> lookup_;     // Sparse
+        Block* arm(int value);
+    public:
+        Switch(Ident &var, std::vector<std::pair<int, Block*>> cases, Block &default_part);
+        void children(std::vector<ASTNode*>& kids) override;
+        void gen_rvalue(CodegenContext& ctx, std::string target_reg) override;
+        void json(std::ostream& out, AST_print_context& ctx) override;
+        int eval_node(EvalContext& ctx) override;
+        void uses(VarUse& use) override;
+        Block* select(EvalContext& ctx) override { return arm(var_.eval(ctx)); }
+        ir::Instr* lower(ir::Builder& b) override;
+        void gen_structured(StructuredCodegenContext& ctx, std::string target) override;
+        void specialize(PartialEval& pe) override;
     };
 
+    /* Replace each long enough chain of tests of one variable against
+     * constants with a Switch, throughout the tree (parser -m).
+     */
+    void make_switches(ASTNode& root);
+
 
 
 
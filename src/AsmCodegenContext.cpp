@@ -0,0 +1,199 @@
+//
+// x86-64 assembly code generation; see AsmCodegenContext.h
+//
+
+#include "AsmCodegenContext.h"
+
+/* Callee-saved registers are saved just below %rbp */
+static const char* saved_regs[] = { "%rbx", "%r12", "%r13", "%r14", "%r15" };
+static const int n_saved = sizeof(saved_regs) / sizeof(saved_regs[0]);
+
+/* %eax, %ecx and %edx are kept back as scratch (and idivl needs
+ * %eax and %edx), so these are the ones alloc_reg hands out.
+ * The caller-saved ones come first; since the only call is the
+ * printf at the very end, we don't have to save them.
+ */
+static const char* allocatable[] = {
+        "%r8d", "%r9d", "%r10d", "%r11d", "%esi", "%edi",
+        "%ebx", "%r12d", "%r13d", "%r14d", "%r15d"
+};
+
+AsmCodegenContext::AsmCodegenContext(std::ostream &out) :
+        CodegenContext(out), frame_size_{8 * n_saved} {
+    int n = sizeof(allocatable) / sizeof(allocatable[0]);
+    // Handed out from the back
+    for (int i = n - 1; i >= 0; --i) {
+        free_regs_.push_back(allocatable[i]);
+    }
+}
+
+void AsmCodegenContext::ins(const std::string& op, const std::string& args) {
+    body_ << "\t" << op << "\t" << args << std::endl;
+}
+
+std::string AsmCodegenContext::new_slot() {
+    frame_size_ += 4;
+    return std::to_string(-frame_size_) + "(%rbp)";
+}
+
+std::string AsmCodegenContext::alloc_reg() {
+    if (! free_regs_.empty()) {
+        std::string reg = free_regs_.back();
+        free_regs_.pop_back();
+        return reg;
+    }
+    // Out of registers; spill
+    if (! free_slots_.empty()) {
+        std::string slot = free_slots_.back();
+        free_slots_.pop_back();
+        return slot;
+    }
+    return new_slot();
+}
+
+void AsmCodegenContext::free_reg(std::string reg) {
+    if (in_memory(reg)) {
+        free_slots_.push_back(reg);
+    } else {
+        free_regs_.push_back(reg);
+    }
+}
+
+std::string AsmCodegenContext::get_local_var(std::string &ident) {
+    auto found = vars_.find(ident);
+    if (found != vars_.end()) { return found->second; }
+    std::string slot = new_slot();
+    vars_[ident] = slot;
+    var_slots_.push_back(slot);
+    return slot;
+}
+
+void AsmCodegenContext::emit_prologue() {
+    // Written in emit_epilogue, when we know the frame size
+}
+
+void AsmCodegenContext::emit_epilogue(std::string result_reg) {
+    int frame = (frame_size_ + 15) / 16 * 16;   // Keep %rsp 16-byte aligned for the call
+    object_code << "\t.section\t.rodata" << std::endl;
+    object_code << ".Lformat:" << std::endl;
+    object_code << "\t.string\t\"-> %d\\n\"" << std::endl;
+    object_code << "\t.text" << std::endl;
+    object_code << "\t.globl\tmain" << std::endl;
+    object_code << "\t.type\tmain, @function" << std::endl;
+    object_code << "main:" << std::endl;
+    object_code << "\tpushq\t%rbp" << std::endl;
+    object_code << "\tmovq\t%rsp, %rbp" << std::endl;
+    object_code << "\tsubq\t$" << frame << ", %rsp" << std::endl;
+    for (int i = 0; i < n_saved; ++i) {
+        object_code << "\tmovq\t" << saved_regs[i] << ", " << -8 * (i + 1) << "(%rbp)" << std::endl;
+    }
+    // Calculator variables start out as zero
+    for (auto& slot : var_slots_) {
+        object_code << "\tmovl\t$0, " << slot << std::endl;
+    }
+    object_code << body_.str();
+    // Print the result
+    object_code << "\tmovl\t" << result_reg << ", %esi" << std::endl;
+    object_code << "\tleaq\t.Lformat(%rip), %rdi" << std::endl;
+    object_code << "\txorl\t%eax, %eax" << std::endl;
+    object_code << "\tcall\tprintf@PLT" << std::endl;
+    for (int i = 0; i < n_saved; ++i) {
+        object_code << "\tmovq\t" << -8 * (i + 1) << "(%rbp), " << saved_regs[i] << std::endl;
+    }
+    object_code << "\txorl\t%eax, %eax" << std::endl;
+    object_code << "\tleave" << std::endl;
+    object_code << "\tret" << std::endl;
+    object_code << "\t.size\tmain, .-main" << std::endl;
+    object_code << "\t.section\t.note.GNU-stack,\"\",@progbits" << std::endl;
+}
+
+void AsmCodegenContext::emit_load_const(std::string reg, int value) {
+    ins("movl", "$" + std::to_string(value) + ", " + reg);
+}
+
+/* Variables are always in memory, so a memory-to-memory
+ * move has to go through a scratch register.
+ */
+void AsmCodegenContext::emit_load(std::string reg, std::string var) {
+    if (in_memory(reg)) {
+        ins("movl", var + ", %eax");
+        ins("movl", "%eax, " + reg);
+    } else {
+        ins("movl", var + ", " + reg);
+    }
+}
+
+void AsmCodegenContext::emit_store(std::string var, std::string reg) {
+    if (in_memory(reg)) {
+        ins("movl", reg + ", %eax");
+        ins("movl", "%eax, " + var);
+    } else {
+        ins("movl", reg + ", " + var);
+    }
+}
+
+void AsmCodegenContext::emit_move(std::string to_reg, std::string from_reg) {
+    if (to_reg == from_reg) { return; }
+    if (in_memory(to_reg) && in_memory(from_reg)) {
+        ins("movl", from_reg + ", %eax");
+        ins("movl", "%eax, " + to_reg);
+    } else {
+        ins("movl", from_reg + ", " + to_reg);
+    }
+}
+
+void AsmCodegenContext::emit_arith(std::string reg, char op, std::string right) {
+    if (op == '/') {
+        ins("movl", reg + ", %eax");
+        ins("cltd", "");
+        ins("idivl", right);
+        ins("movl", "%eax, " + reg);
+        return;
+    }
+    const char* instr = op == '+' ? "addl" : op == '-' ? "subl" : "imull";
+    // imull can't have a memory destination, and nothing can
+    // have two memory operands
+    if (in_memory(reg) && (op == '*' || in_memory(right))) {
+        ins("movl", reg + ", %eax");
+        ins(instr, right + ", %eax");
+        ins("movl", "%eax, " + reg);
+    } else {
+        ins(instr, right + ", " + reg);
+    }
+}
+
+void AsmCodegenContext::emit_compare_jump(std::string left, std::string op,
+                                          std::string right, std::string label) {
+    const char* jump = op == "<" ? "jl" : op == "<=" ? "jle" : op == ">" ? "jg"
+                     : op == ">=" ? "jge" : "je";
+    ins("movl", left + ", %eax");
+    ins("cmpl", right + ", %eax");
+    ins(jump, asm_label(label));
+}
+
+void AsmCodegenContext::emit_test_jump(std::string reg, std::string label) {
+    ins("cmpl", "$0, " + reg);
+    ins("jne", asm_label(label));
+}
+
+/* A compare and branch for each value.  (A jump table would take
+ * the arm in one step, but needs a bounds check and a table in
+ * .rodata; a chain is fine for the sizes we see.)
+ */
+void AsmCodegenContext::emit_switch(std::string reg, const std::vector<std::pair<int, std::string>>& cases,
+                                    std::string default_label) {
+    ins("movl", reg + ", %eax");
+    for (auto &c: cases) {
+        ins("cmpl", "$" + std::to_string(c.first) + ", %eax");
+        ins("je", asm_label(c.second));
+    }
+    ins("jmp", asm_label(default_label));
+}
+
+void AsmCodegenContext::emit_jump(std::string label) {
+    ins("jmp", asm_label(label));
+}
+
+void AsmCodegenContext::emit_label(std::string label) {
+    body_ << asm_label(label) << ":" << std::endl;
+}
@@ -0,0 +1,58 @@
+//
+// Code generation context that produces x86-64 assembly language
+// (GNU as syntax) instead of C, so that the generated program needs
+// only the assembler and linker, not a whole C compiler.
+//
+// "Registers" handed out by alloc_reg are real machine registers as
+// long as there are some left; after that they are spilled to stack
+// slots.  Either way the register name is just an operand string
+// like "%ebx" or "-52(%rbp)", so the AST can pass it around without
+// knowing which it got.  Calculator variables live in stack slots.
+//
+// We don't know how big the stack frame will be until we have seen
+// the whole program, so the body is buffered and written out
+// together with the prologue in emit_epilogue.
+//
+
+#ifndef AST_ASMCODEGENCONTEXT_H
+#define AST_ASMCODEGENCONTEXT_H
+
+#include "CodegenContext.h"
+#include <sstream>
+#include <vector>
+
+class AsmCodegenContext : public CodegenContext {
+    std::stringstream body_;
+    std::vector<std::string> free_regs_;    // Registers we can still hand out
+    std::vector<std::string> free_slots_;   // Spill slots no longer in use
+    std::vector<std::string> var_slots_;    // Zeroed in the prologue
+    std::map<std::string, std::string> vars_;
+    int frame_size_;                        // Bytes below %rbp, so far
+
+    void ins(const std::string& op, const std::string& args);
+    std::string new_slot();
+    static bool in_memory(const std::string& operand) { return operand[0] != '%'; }
+    static std::string asm_label(const std::string& label) { return ".L" + label; }
+public:
+    explicit AsmCodegenContext(std::ostream &out);
+
+    std::string alloc_reg() override;
+    void free_reg(std::string reg) override;
+    std::string get_local_var(std::string &ident) override;
+
+    void emit_prologue() override;
+    void emit_epilogue(std::string result_reg) override;
+    void emit_load_const(std::string reg, int value) override;
+    void emit_load(std::string reg, std::string var) override;
+    void emit_store(std::string var, std::string reg) override;
+    void emit_move(std::string to_reg, std::string from_reg) override;
+    void emit_arith(std::string reg, char op, std::string right) override;
+    void emit_compare_jump(std::string left, std::string op, std::string right, std::string label) override;
+    void emit_test_jump(std::string reg, std::string label) override;
+    void emit_switch(std::string reg, const std::vector<std::pair<int, std::string>>& cases,
+                     std::string default_label) override;
+    void emit_jump(std::string label) override;
+    void emit_label(std::string label) override;
+};
+
+#endif //AST_ASMCODEGENCONTEXT_H
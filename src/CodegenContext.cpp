@@ -3,6 +3,131 @@
 //
 
 #include "CodegenContext.h"
+#include "IR.h"
+#include <cassert>
 
-// Nothing here currently
+/* Code generation from the SSA intermediate representation.
+ *
+ * Each value gets a register, from just before its definition until
+ * its last use.  The blocks are in an order where every edge points
+ * forward, so "last use" is simply the last place it is mentioned in
+ * that order.  Constants don't get registers of their own; they are
+ * loaded into a scratch register where they are used.  Compares are
+ * not computed as values either; the branch that uses a compare
+ * becomes a compare-and-jump.  A phi is a register that each
+ * predecessor fills in just before it jumps to the join.
+ */
+void CodegenContext::emit_function(ir::Function& fn) {
+    std::map<ir::Instr*, int> last_use;
+    std::map<ir::Instr*, std::string> regs;
+    std::map<int, std::vector<ir::Instr*>> dies_at;
 
+    // Number the places things happen: one per instruction,
+    // and one for the end of each block.
+    int pos = 0;
+    auto use = [&](ir::Instr* value) {
+        value = ir::resolve(value);
+        if (value->op == ir::Const) { return; }
+        if (ir::is_compare(value->op)) {
+            for (ir::Instr* arg : value->args) { last_use[ir::resolve(arg)] = pos; }
+            return;
+        }
+        last_use[value] = pos;
+    };
+    for (ir::BasicBlock* block : fn.blocks) {
+        for (ir::Instr* instr : block->instrs) {
+            if (instr->op == ir::Phi || instr->op == ir::Const || ir::is_compare(instr->op)) { continue; }
+            last_use[instr] = pos;   // Dies right away if nobody uses it
+            for (ir::Instr* arg : instr->args) { use(arg); }
+            ++pos;
+        }
+        for (ir::BasicBlock* succ : block->succs) {
+            for (ir::Instr* instr : succ->instrs) {
+                if (instr->op != ir::Phi) { continue; }
+                last_use[instr] = pos;   // Must live through all the copies into it
+                for (size_t k = 0; k < succ->preds.size(); ++k) {
+                    if (succ->preds[k] == block) { use(instr->args[k]); }
+                }
+            }
+        }
+        if (block->value != nullptr) { use(block->value); }
+        ++pos;
+    }
+    for (auto& value : last_use) { dies_at[value.second].push_back(value.first); }
+
+    std::vector<std::string> scratch;
+    auto operand = [&](ir::Instr* value) {
+        value = ir::resolve(value);
+        if (value->op == ir::Const) {
+            std::string reg = alloc_reg();
+            emit_load_const(reg, value->imm);
+            scratch.push_back(reg);
+            return reg;
+        }
+        assert(regs.count(value) == 1);
+        return regs[value];
+    };
+    auto done_with = [&](int at) {
+        for (auto& reg : scratch) { free_reg(reg); }
+        scratch.clear();
+        for (ir::Instr* value : dies_at[at]) {
+            if (regs.count(value)) { free_reg(regs[value]); }
+        }
+    };
+    auto compare_op = [](ir::Op op) {
+        return op == ir::Less ? "<" : op == ir::AtMost ? "<=" : op == ir::Greater ? ">"
+             : op == ir::AtLeast ? ">=" : "==";
+    };
+    auto arith_op = [](ir::Op op) {
+        return op == ir::Add ? '+' : op == ir::Sub ? '-' : op == ir::Mul ? '*' : '/';
+    };
+
+    emit_prologue();
+    pos = 0;
+    for (ir::BasicBlock* block : fn.blocks) {
+        emit_label(block->name);
+        for (ir::Instr* instr : block->instrs) {
+            if (instr->op == ir::Phi || instr->op == ir::Const || ir::is_compare(instr->op)) { continue; }
+            std::string target = alloc_reg();
+            regs[instr] = target;
+            emit_move(target, operand(instr->args[0]));
+            emit_arith(target, arith_op(instr->op), operand(instr->args[1]));
+            done_with(pos++);
+        }
+        for (ir::BasicBlock* succ : block->succs) {
+            for (ir::Instr* instr : succ->instrs) {
+                if (instr->op != ir::Phi) { continue; }
+                assert(block->term == ir::BasicBlock::Jump);
+                if (regs.count(instr) == 0) { regs[instr] = alloc_reg(); }
+                for (size_t k = 0; k < succ->preds.size(); ++k) {
+                    if (succ->preds[k] == block) { emit_move(regs[instr], operand(instr->args[k])); }
+                }
+            }
+        }
+        switch (block->term) {
+            case ir::BasicBlock::Jump:
+                done_with(pos);
+                emit_jump(block->succs[0]->name);
+                break;
+            case ir::BasicBlock::Branch: {
+                ir::Instr* cond = ir::resolve(block->value);
+                if (ir::is_compare(cond->op)) {
+                    std::string left = operand(cond->args[0]);
+                    emit_compare_jump(left, compare_op(cond->op), operand(cond->args[1]), block->succs[0]->name);
+                } else {
+                    emit_test_jump(operand(cond), block->succs[0]->name);
+                }
+                emit_jump(block->succs[1]->name);
+                done_with(pos);
+                break;
+            }
+            case ir::BasicBlock::Return: {
+                std::string result = operand(block->value);
+                emit_epilogue(result);
+                done_with(pos);
+                break;
+            }
+        }
+        ++pos;
+    }
+}
@@ -8,12 +8,23 @@
 // them to C code and then compiling and running the C code) we
 // need an output stream and a table of variable values.
 //
+// The AST asks the context for each operation (load, store, arithmetic,
+// jumps) rather than writing C itself, so that a different context can
+// produce a different target language with the same walk of the tree.
+// This class produces C; AsmCodegenContext produces x86-64 assembly.
+//
 
 #ifndef AST_CODEGENCONTEXT_H
 #define AST_CODEGENCONTEXT_H
 
 #include <ostream>
 #include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ir { class Function; }
+namespace AST { class Profile; }
 
 class CodegenContext {
     // In place of registers, we'll use local integer variables.
@@ -22,24 +33,62 @@ class CodegenContext {
     int next_reg_num = 0;
     int next_label_num = 0;
     std::map<std::string, std::string> local_vars;
+
+    // Jumps are held back until we see what comes next, so that
+    //    goto L;  L: ;                  becomes    L: ;
+    //    if (c) goto A; goto B;  A: ;   becomes    if (!(c)) goto B;  A: ;
+    std::string pending_test_;          // Condition of a held conditional jump
+    std::string pending_negated_;       // ... and its negation
+    std::string pending_test_label_;
+    std::string pending_jump_;          // Target of a held unconditional jump
+    // Labels we expect jumps to be taken to (true) or not (false)
+    std::map<std::string, bool> label_hints_;
+    void flush() {
+        if (! pending_test_label_.empty()) {
+            auto hint = label_hints_.find(pending_test_label_);
+            if (hint == label_hints_.end()) {
+                object_code << " if (" << pending_test_ << ") goto " << pending_test_label_ << ";" << std::endl;
+            } else {
+                object_code << " if (__builtin_expect(!!(" << pending_test_ << "), " << hint->second << ")) goto "
+                            << pending_test_label_ << ";" << std::endl;
+            }
+        }
+        if (! pending_jump_.empty()) {
+            object_code << " goto " << pending_jump_ << ";" << std::endl;
+        }
+        pending_test_label_.clear();
+        pending_jump_.clear();
+    }
+    void hold_test(std::string test, std::string negated, std::string label) {
+        flush();
+        pending_test_ = test;
+        pending_negated_ = negated;
+        pending_test_label_ = label;
+    }
+protected:
     std::ostream &object_code;
 public:
     explicit CodegenContext(std::ostream &out) : object_code{out} {};
-    void emit(std::string s) { object_code << " " << s  << std::endl; }
+    /* From parser -P, to guide the layout of branches */
+    const AST::Profile* profile = nullptr;
+    virtual ~CodegenContext() {}
+    void emit(std::string s) { flush(); object_code << " " << s  << std::endl; }
 
     /* Getting the name of a "register" (really a local variable in C)
      * has the side effect of emitting a declaration for the variable.
      */
-    std::string alloc_reg() {
+    virtual std::string alloc_reg() {
         int reg_num = next_reg_num++;
         std::string reg_name = "tmp__" + std::to_string(reg_num);
+        flush();
         object_code << "int " << reg_name << ";" << std::endl;
         return reg_name;
     }
 
-    void free_reg(std::string reg) {
+    virtual void free_reg(std::string reg) {
         // We don't have real registers, so there is nothing to free.
-        this->emit(std::string("// Free ") + reg);
+        // (Just a comment, so it need not stop us holding back a jump.)
+        object_code << " // Free " << reg << std::endl;
     }
 
     /* Get internal name for a calculator variable.
@@ -47,7 +96,7 @@ public:
      * the variable has not been mentioned before.  (Later,
      * we should buffer up the program to avoid this.)
      */
-    std::string get_local_var(std::string &ident) {
+    virtual std::string get_local_var(std::string &ident) {
         if (local_vars.count(ident) == 0) {
             std::string internal = std::string("calc_var_") + ident;
             local_vars[ident] = internal;
@@ -68,6 +117,93 @@ public:
         return std::string(prefix) + "_" + std::to_string(++next_label_num);
     }
 
+    /* Jumps to this label are likely (or unlikely) to be taken.
+     * In C that's __builtin_expect on the condition; other
+     * targets may ignore it.
+     */
+    void hint_label(std::string label, bool likely) {
+        label_hints_[label] = likely;
+    }
+
+    /* The operations.  'reg' arguments come from alloc_reg, and
+     * 'var' arguments from get_local_var.
+     */
+
+    // Start and end of the program; the end prints the result
+    virtual void emit_prologue() {
+        emit("#include <stdio.h>");
+        emit("int main(int argc, char **argv) {");
+    }
+    virtual void emit_epilogue(std::string result_reg) {
+        emit(std::string(R"(printf("-> %d\n",)") + result_reg + ");");
+        emit("}");
+    }
+
+    virtual void emit_load_const(std::string reg, int value) {
+        emit(reg + " = " + std::to_string(value) + "; // LOAD constant value");
+    }
+    /* In assembly language we would generate a LOAD instruction;
+     * in C we generate an assignment.
+     */
+    virtual void emit_load(std::string reg, std::string var) {
+        emit(reg + " = " + var + "; // LOAD");
+    }
+    virtual void emit_store(std::string var, std::string reg) {
+        emit(var + "= " + reg + ";");
+    }
+    virtual void emit_move(std::string to_reg, std::string from_reg) {
+        emit(to_reg + " = " + from_reg + ";");
+    }
+
+    /* reg = reg op right, where op is one of + - * / */
+    virtual void emit_arith(std::string reg, char op, std::string right) {
+        const char* name = op == '+' ? "Plus" : op == '-' ? "Minus" : op == '*' ? "Times" : "Div";
+        emit(reg + " = (" + reg + ") " + op + " (" + right + "); // " + name);
+    }
+
+    /* Jump to label if left op right, where op is a C comparison */
+    virtual void emit_compare_jump(std::string left, std::string op, std::string right, std::string label) {
+        std::string negated = op == "<" ? ">=" : op == "<=" ? ">" : op == ">" ? "<="
+                            : op == ">=" ? "<" : "!=";
+        hold_test(left + op + right, left + negated + right, label);
+    }
+    /* Jump to label if reg is non-zero */
+    virtual void emit_test_jump(std::string reg, std::string label) {
+        hold_test(reg, "!" + reg, label);
+    }
+    /* Jump to the label paired with the value in reg, or to default_label */
+    virtual void emit_switch(std::string reg, const std::vector<std::pair<int, std::string>>& cases,
+                             std::string default_label) {
+        emit("switch (" + reg + ") {");
+        for (auto &c: cases) {
+            emit("case " + std::to_string(c.first) + ": goto " + c.second + ";");
+        }
+        emit("default: goto " + default_label + ";");
+        emit("}");
+    }
+    virtual void emit_jump(std::string label) {
+        if (! pending_jump_.empty()) { flush(); }
+        pending_jump_ = label;
+    }
+    virtual void emit_label(std::string label) {
+        if (pending_jump_ == label) {
+            pending_jump_.clear();
+        } else if (pending_test_label_ == label && ! pending_jump_.empty()) {
+            // Branch around the label instead of to it
+            pending_test_ = pending_negated_;
+            pending_test_label_ = pending_jump_;
+            pending_jump_.clear();
+        }
+        if (pending_test_label_ == label) {
+            pending_test_label_.clear();   // Goes here either way
+        }
+        emit(label + ": ;");
+    }
+
+    /* Generate a whole program from the SSA intermediate representation
+     * instead of from the AST, using the same operations.
+     */
+    void emit_function(ir::Function& fn);
 };
 
 
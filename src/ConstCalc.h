@@ -0,0 +1,400 @@
+//
+// Compile-time calculator:  A scanner, parser and evaluator for
+// calculator programs in one header, all constexpr (C++14), so that a
+// program embedded in C++ source as a string literal is evaluated by
+// the C++ compiler, with nothing left to do at run time:
+//
+//     constexpr int area = constcalc::eval("w = 3 h = 4 w * h");
+//     static_assert(constcalc::eval("if 2 > 1 then 7 else 8 fi") == 7, "");
+//
+// It takes the language of calc.lxx and calc.yxx (the same tokens,
+// the same precedence and associativity, if/elif/else/fi, and/or/not)
+// and gives the value ASTNode::eval would.  It needs nothing else from
+// this directory, and no scanner or parser generator.
+//
+// A program with a syntax error (or an unexpected character, or a
+// division by zero, or INT_MIN / -1) is not a constant expression, so in a constexpr
+// context it is a compile error, and the compiler's notes show the
+// call to fail() with the reason.  Arithmetic overflow is likewise a
+// compile error.  Called at run time, fail() throws
+// std::invalid_argument instead.  There is no error recovery:  the
+// first error is the only one.
+//
+// Programs are limited to a fixed number of nodes and variables, the
+// template parameters of Program and eval.
+//
+
+#ifndef CONSTCALC_H
+#define CONSTCALC_H
+
+#include <climits>
+#include <stdexcept>
+
+namespace constcalc {
+
+    /* Never a constant expression, unless there's no reason */
+    constexpr int fail(const char* why) {
+        return why == nullptr ? 0 : throw std::invalid_argument(why);
+    }
+
+    /* ============ Scanner ============ */
+
+    enum class Tok {
+        End, Number, Ident,
+        Plus, Minus, Times, Div, LParen, RParen,
+        Less, Greater, AtMost, AtLeast, Equals, Gets,
+        If, Then, Else, Elif, Fi, And, Or, Not
+    };
+
+    struct Token {
+        Tok kind = Tok::End;
+        const char* text = nullptr;
+        int length = 0;
+        int value = 0;        // Of a Number
+    };
+
+    constexpr bool is_digit(char c) { return c >= '0' && c <= '9'; }
+    constexpr bool is_word(char c) {
+        return is_digit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+    }
+
+    constexpr bool same(const char* text, int length, const char* word) {
+        int i = 0;
+        for (; i < length; ++i) {
+            if (word[i] != text[i]) { return false; }
+        }
+        return word[i] == '\0';
+    }
+
+    // Like calc.lxx:  Only blanks and newlines are white space.  A run
+    // of letters, digits and underscores is a keyword, an identifier,
+    // or, if it's all digits, an integer literal.
+    class Scanner {
+        const char* p_;
+        const char* end_;
+
+        constexpr Token token(Tok kind, const char* start) const {
+            Token t;
+            t.kind = kind;
+            t.text = start;
+            t.length = (int) (p_ - start);
+            return t;
+        }
+
+        constexpr Tok keyword(const char* text, int length) const {
+            return same(text, length, "if") ? Tok::If
+                 : same(text, length, "then") ? Tok::Then
+                 : same(text, length, "else") ? Tok::Else
+                 : same(text, length, "elif") ? Tok::Elif
+                 : same(text, length, "fi") ? Tok::Fi
+                 : same(text, length, "and") ? Tok::And
+                 : same(text, length, "or") ? Tok::Or
+                 : same(text, length, "not") ? Tok::Not
+                 : Tok::Ident;
+        }
+
+    public:
+        constexpr Scanner(const char* text, int length) : p_{text}, end_{text + length} {}
+
+        constexpr Token next() {
+            while (p_ < end_ && (*p_ == ' ' || *p_ == '\n')) { ++p_; }
+            const char* start = p_;
+            if (p_ == end_) { return token(Tok::End, start); }
+            if (is_word(*p_)) {
+                bool digits = true;
+                long value = 0;
+                while (p_ < end_ && is_word(*p_)) {
+                    if (! is_digit(*p_)) { digits = false; }
+                    if (digits && value <= INT_MAX) { value = value * 10 + (*p_ - '0'); }
+                    ++p_;
+                }
+                if (! digits) { return token(keyword(start, (int) (p_ - start)), start); }
+                if (value > INT_MAX) { fail("integer literal too large"); }
+                Token t = token(Tok::Number, start);
+                t.value = (int) value;
+                return t;
+            }
+            char c = *p_++;
+            bool eq = p_ < end_ && *p_ == '=';
+            switch (c) {
+                case '+': return token(Tok::Plus, start);
+                case '-': return token(Tok::Minus, start);
+                case '*': return token(Tok::Times, start);
+                case '/': return token(Tok::Div, start);
+                case '(': return token(Tok::LParen, start);
+                case ')': return token(Tok::RParen, start);
+                case '<': if (eq) { ++p_; return token(Tok::AtMost, start); }
+                          return token(Tok::Less, start);
+                case '>': if (eq) { ++p_; return token(Tok::AtLeast, start); }
+                          return token(Tok::Greater, start);
+                case '=': if (eq) { ++p_; return token(Tok::Equals, start); }
+                          return token(Tok::Gets, start);
+                default:  fail("unexpected character");
+            }
+            return token(Tok::End, start);
+        }
+    };
+
+    /* ============ Parser and evaluator ============ */
+
+    template <int MaxNodes = 256, int MaxVars = 32>
+    class Program {
+        enum Op {
+            Block, Const, Var, Assign, If,
+            Plus, Minus, Times, Div,
+            And, Or, Not, AsBool,
+            Less, Greater, AtMost, AtLeast, Equals
+        };
+        // Children are indexes into nodes_, or -1 for none.  A block's
+        // statements are a list from left through next.
+        struct Node {
+            Op op = Const;
+            int value = 0;    // Of a Const; variable number of a Var or Assign
+            int left = -1;
+            int right = -1;
+            int third = -1;
+            int next = -1;
+        };
+
+        Node nodes_[MaxNodes] {};
+        int size_ = 0;
+        const char* names_[MaxVars] {};
+        int name_lengths_[MaxVars] {};
+        int vars_ = 0;
+        int root_ = -1;
+        Scanner scanner_;
+        Token tok_;
+
+        constexpr int node(Op op, int left = -1, int right = -1, int third = -1, int value = 0) {
+            if (size_ == MaxNodes) { fail("program has too many nodes for Program<MaxNodes>"); }
+            Node& n = nodes_[size_];
+            n.op = op;
+            n.value = value;
+            n.left = left;
+            n.right = right;
+            n.third = third;
+            return size_++;
+        }
+
+        constexpr int variable(const char* text, int length) {
+            for (int i = 0; i < vars_; ++i) {
+                if (name_lengths_[i] != length) { continue; }
+                int j = 0;
+                while (j < length && names_[i][j] == text[j]) { ++j; }
+                if (j == length) { return i; }
+            }
+            if (vars_ == MaxVars) { fail("program has too many variables for Program<MaxVars>"); }
+            names_[vars_] = text;
+            name_lengths_[vars_] = length;
+            return vars_++;
+        }
+
+        constexpr void advance() { tok_ = scanner_.next(); }
+        constexpr void expect(Tok kind, const char* why) {
+            if (tok_.kind != kind) { fail(why); }
+            advance();
+        }
+
+        /* Grammar, as in calc.yxx, from the top down */
+
+        static constexpr bool starts_stmt(Tok kind) {
+            return kind == Tok::Ident || kind == Tok::Number || kind == Tok::LParen || kind == Tok::If;
+        }
+
+        // block: stmt+
+        constexpr int block() {
+            if (! starts_stmt(tok_.kind)) { fail("expected a statement"); }
+            int first = stmt();
+            int last = first;
+            while (starts_stmt(tok_.kind)) {
+                int s = stmt();
+                nodes_[last].next = s;
+                last = s;
+            }
+            return node(Block, first);
+        }
+
+        // stmt: IDENT '=' expr | expr | ifstmt
+        constexpr int stmt() {
+            if (tok_.kind == Tok::If) { return if_stmt(); }
+            if (tok_.kind == Tok::Ident) {
+                Scanner ahead = scanner_;
+                if (ahead.next().kind == Tok::Gets) {
+                    int var = variable(tok_.text, tok_.length);
+                    advance();
+                    advance();
+                    return node(Assign, expr(), -1, -1, var);
+                }
+            }
+            return expr();
+        }
+
+        // ifstmt: IF cond THEN block alternatives FI
+        constexpr int if_stmt() {
+            advance();
+            int cond = condition();
+            expect(Tok::Then, "expected 'then'");
+            int then_part = block();
+            int else_part = alternatives();
+            expect(Tok::Fi, "expected 'fi'");
+            return node(If, cond, then_part, else_part);
+        }
+
+        // alternatives: (empty) | ELSE block | ELIF cond THEN block alternatives
+        // An elif is an 'if' alone in the else part, and shares the 'fi'.
+        constexpr int alternatives() {
+            if (tok_.kind == Tok::Else) {
+                advance();
+                return block();
+            }
+            if (tok_.kind != Tok::Elif) { return -1; }
+            advance();
+            int cond = condition();
+            expect(Tok::Then, "expected 'then'");
+            int then_part = block();
+            int else_part = alternatives();
+            return node(Block, node(If, cond, then_part, else_part));
+        }
+
+        // 'and' and 'or' have the same precedence and group to the left
+        constexpr int condition() {
+            int left = negation();
+            while (tok_.kind == Tok::And || tok_.kind == Tok::Or) {
+                Op op = tok_.kind == Tok::And ? And : Or;
+                advance();
+                left = node(op, left, negation());
+            }
+            return left;
+        }
+
+        // 'not' binds tighter than 'and' and 'or', looser than comparisons
+        constexpr int negation() {
+            if (tok_.kind == Tok::Not) {
+                advance();
+                return node(Not, negation());
+            }
+            int left = expr();
+            Op op = comparison(tok_.kind);
+            if (op == AsBool) { return node(AsBool, left); }
+            advance();
+            int right = expr();
+            if (comparison(tok_.kind) != AsBool) { fail("comparisons don't associate"); }
+            return node(op, left, right);
+        }
+
+        static constexpr Op comparison(Tok kind) {
+            return kind == Tok::Less ? Less
+                 : kind == Tok::Greater ? Greater
+                 : kind == Tok::AtMost ? AtMost
+                 : kind == Tok::AtLeast ? AtLeast
+                 : kind == Tok::Equals ? Equals
+                 : AsBool;
+        }
+
+        // + and - group to the left, below * and /
+        constexpr int expr() {
+            int left = term();
+            while (tok_.kind == Tok::Plus || tok_.kind == Tok::Minus) {
+                Op op = tok_.kind == Tok::Plus ? Plus : Minus;
+                advance();
+                left = node(op, left, term());
+            }
+            return left;
+        }
+
+        constexpr int term() {
+            int left = primary();
+            while (tok_.kind == Tok::Times || tok_.kind == Tok::Div) {
+                Op op = tok_.kind == Tok::Times ? Times : Div;
+                advance();
+                left = node(op, left, primary());
+            }
+            return left;
+        }
+
+        constexpr int primary() {
+            if (tok_.kind == Tok::Number) {
+                int value = tok_.value;
+                advance();
+                return node(Const, -1, -1, -1, value);
+            }
+            if (tok_.kind == Tok::Ident) {
+                int var = variable(tok_.text, tok_.length);
+                advance();
+                return node(Var, -1, -1, -1, var);
+            }
+            expect(Tok::LParen, "expected an expression");
+            int inner = expr();
+            expect(Tok::RParen, "expected ')'");
+            return inner;
+        }
+
+        /* Evaluation, as in ASTNode::eval.  Variables start at 0. */
+        constexpr int eval(int n, int* vars) const {
+            const Node& node = nodes_[n];
+            switch (node.op) {
+                case Block: {
+                    int value = 0;
+                    for (int s = node.left; s != -1; s = nodes_[s].next) { value = eval(s, vars); }
+                    return value;
+                }
+                case Const: return node.value;
+                case Var: return vars[node.value];
+                case Assign: return vars[node.value] = eval(node.left, vars);
+                case If: {
+                    int arm = eval(node.left, vars) ? node.right : node.third;
+                    return arm == -1 ? 0 : eval(arm, vars);
+                }
+                case Plus: return eval(node.left, vars) + eval(node.right, vars);
+                case Minus: return eval(node.left, vars) - eval(node.right, vars);
+                case Times: return eval(node.left, vars) * eval(node.right, vars);
+                case Div: {
+                    int dividend = eval(node.left, vars);
+                    int divisor = eval(node.right, vars);
+                    return divisor == 0 ? fail("division by zero")
+                         : divisor == -1 && dividend == INT_MIN ? fail("division overflow")
+                         : dividend / divisor;
+                }
+                case And: return eval(node.left, vars) && eval(node.right, vars);
+                case Or: return eval(node.left, vars) || eval(node.right, vars);
+                case Not: return ! eval(node.left, vars);
+                case AsBool: return eval(node.left, vars);
+                case Less: return eval(node.left, vars) < eval(node.right, vars);
+                case Greater: return eval(node.left, vars) > eval(node.right, vars);
+                case AtMost: return eval(node.left, vars) <= eval(node.right, vars);
+                case AtLeast: return eval(node.left, vars) >= eval(node.right, vars);
+                case Equals: return eval(node.left, vars) == eval(node.right, vars);
+            }
+            return fail("bad node");
+        }
+
+    public:
+        constexpr Program(const char* text, int length) : scanner_{text, length} {
+            advance();
+            root_ = block();
+            if (tok_.kind != Tok::End) { fail("expected the end of the program"); }
+        }
+
+        /* The value of the last statement, starting with all variables 0 */
+        constexpr int eval() const {
+            int vars[MaxVars] {};
+            return eval(root_, vars);
+        }
+
+        constexpr int size() const { return size_; }
+    };
+
+    constexpr int length_of(const char* text) {
+        int n = 0;
+        while (text[n] != '\0') { ++n; }
+        return n;
+    }
+
+    template <int MaxNodes = 256, int MaxVars = 32>
+    constexpr int eval(const char* text) {
+        return Program<MaxNodes, MaxVars>(text, length_of(text)).eval();
+    }
+
+}
+
+#endif //CONSTCALC_H
@@ -0,0 +1,367 @@
+//
+// Hand-written parser; see DescentParser.h
+//
+// The comments give the Bison states (calc.output, from bison -r all)
+// that each error check stands for.
+//
+
+#include "DescentParser.h"
+#include "NodeFactory.h"
+#include "Messages.h"
+#include <cstdlib>
+
+namespace yy {
+
+    typedef parser::token t;
+
+    static const int none = -1;     // No lookahead read yet
+    static const int end = 0;       // The scanner's end of input
+
+    /* Thrown where Bison would YYABORT */
+    struct Abort {};
+
+    static bool starts_expr(int kind) {
+        return kind == t::IDENT || kind == t::NUMBER || kind == t::LPAREN;
+    }
+
+    static bool starts_cond(int kind) { return starts_expr(kind) || kind == t::NOT; }
+
+    /* 1 for + and -, 2 for * and /, 0 for anything else */
+    static int precedence(int kind) {
+        switch (kind) {
+            case t::PLUS: case t::MINUS: return 1;
+            case t::TIMES: case t::DIV: return 2;
+            default: return 0;
+        }
+    }
+
+    /* ============ Tokens ============ */
+
+    int DescentParser::peek() {
+        if (kind_ == none) { kind_ = lexer_.yylex(&value_, &loc_); }
+        return kind_;
+    }
+
+    // Every token we use is one that Bison would shift
+    void DescentParser::shift() {
+        kind_ = none;
+        if (errstatus_) { --errstatus_; }
+    }
+
+    void DescentParser::discard() {
+        if (kind_ == t::IDENT) { free(value_.str); }
+        kind_ = none;
+    }
+
+    /* ============ Errors ============ */
+
+    // Report the error unless we are still recovering from the last
+    // one.  If we haven't used a token since, we failed to resume
+    // with this one, so it goes.
+    void DescentParser::syntax_error() {
+        if (errstatus_ == 0) {
+            report::error_at(loc_, "syntax error");
+        } else if (errstatus_ == 3) {
+            if (peek() == end) { throw Abort(); }
+            discard();
+        }
+        errstatus_ = 3;
+    }
+
+    // We are where Bison shifts the error token.  Discard tokens until
+    // one it can shift next, which is a leaf (expr: error leaf), or,
+    // right after IF, a FI (ifstmt: IF error FI).
+    void DescentParser::skip_to_leaf(bool or_fi) {
+        for (;;) {
+            int kind = peek();
+            if (kind == t::IDENT || kind == t::NUMBER || (or_fi && kind == t::FI)) { return; }
+            if (kind == end) { throw Abort(); }
+            discard();
+        }
+    }
+
+    /* ============ Statements ============ */
+
+    int DescentParser::parse() {
+        kind_ = none;
+        loc_ = location();
+        errstatus_ = 0;
+        frames_.clear();
+        arms_.clear();
+        pending_.clear();
+        try {
+            program();
+            return 0;
+        } catch (Abort& e) {
+            discard();
+            return 1;
+        } catch (...) {     // Too many errors, or some other limit
+            discard();
+            throw;
+        }
+    }
+
+    // The program, and each part of an if, is a block on frames_.  A
+    // block may end only before the tokens that can follow it, and
+    // anything else that can't start a statement is an error (states
+    // 0, 7, 30, 43, 51, 54, 57 and 58).  Bison resumes with an
+    // expression statement in the same block.
+    void DescentParser::program() {
+        frames_.push_back(Frame{nullptr, END_OF_INPUT, 0});
+        for (;;) {
+            Frame& frame = frames_.back();
+            int kind = peek();
+            if (frame.block) {
+                if (frame.follow == END_OF_INPUT && kind == end) {
+                    *root_ = frame.block;
+                    return;
+                }
+                if (frame.follow == ELSE_ELIF_FI && (kind == t::ELSE || kind == t::ELIF || kind == t::FI)) {
+                    arms_.back().second = frame.block;
+                    frame.block = nullptr;
+                    if (kind == t::FI) {
+                        end_if();
+                    } else if (kind == t::ELSE) {
+                        shift();
+                        frame.follow = FI_ONLY;
+                    } else {
+                        shift();
+                        arms_.push_back(std::make_pair(elif_cond(), nullptr));
+                    }
+                    continue;
+                }
+                if (frame.follow == FI_ONLY && kind == t::FI) {
+                    end_if();
+                    continue;
+                }
+            }
+            if (kind == t::IF) {
+                shift();
+                AST::ASTNode* cond = if_cond();
+                if (cond) {
+                    arms_.push_back(std::make_pair(cond, nullptr));
+                    frames_.push_back(Frame{nullptr, ELSE_ELIF_FI, arms_.size() - 1});
+                } else {
+                    append(nullptr);
+                }
+                continue;
+            }
+            AST::ASTNode* stmt;
+            if (starts_expr(kind)) {
+                stmt = this->stmt();
+            } else {
+                syntax_error();
+                skip_to_leaf(false);
+                stmt = expr(leaf());
+            }
+            append(stmt);
+        }
+    }
+
+    void DescentParser::append(AST::ASTNode* stmt) {
+        Frame& frame = frames_.back();
+        if (! frame.block) { frame.block = new AST::Block(); }
+        frame.block->append(stmt);
+    }
+
+    // At the FI, the elifs become nested ifs from the last one out, and
+    // then the whole if goes in the enclosing block, as Bison reduces
+    // them.  Without an else, the last false part is an empty block.
+    void DescentParser::end_if() {
+        Frame frame = frames_.back();
+        frames_.pop_back();
+        AST::Block* falsepart = frame.follow == FI_ONLY ? frame.block : new AST::Block();
+        for (size_t arm = arms_.size() - 1; arm > frame.arms; --arm) {
+            AST::Block* elif = new AST::Block();
+            elif->append(new AST::If(*arms_[arm].first, *arms_[arm].second, *falsepart));
+            falsepart = elif;
+        }
+        shift();
+        AST::ASTNode* stmt = new AST::If(*arms_[frame.arms].first, *arms_[frame.arms].second, *falsepart);
+        arms_.resize(frame.arms);
+        append(stmt);
+    }
+
+    AST::ASTNode* DescentParser::stmt() {
+        if (peek() != t::IDENT) { return expr(nullptr); }
+        // An assignment, or an expression that starts with a variable
+        std::string name(value_.str);
+        free(value_.str);
+        shift();
+        if (peek() != t::GETS) { return expr(AST::NodeFactory::ident(name)); }
+        shift();
+        AST::ASTNode* rhs = expr(nullptr);
+        AST::Ident* lhs = AST::NodeFactory::ident(name);
+        return new AST::Assign(*lhs, *rhs);
+    }
+
+    // A bad start or end to the condition (states 4 and 18) goes back
+    // to just after IF, where a FI ends the whole statement (with no
+    // tree, as in Bison, so nullptr) and a leaf starts the condition
+    // over.  The THEN is taken too.
+    AST::ASTNode* DescentParser::if_cond() {
+        AST::ASTNode* cond = nullptr;
+        if (starts_cond(peek())) { cond = this->cond(nullptr); }
+        while (! cond || peek() != t::THEN) {
+            syntax_error();
+            skip_to_leaf(true);
+            if (peek() == t::FI) {
+                shift();
+                return nullptr;
+            }
+            cond = this->cond(leaf());
+        }
+        shift();
+        return cond;
+    }
+
+    // After ELIF, a bad condition (states 52 and 55) starts over
+    // with a leaf, as after IF but without the FI.
+    AST::ASTNode* DescentParser::elif_cond() {
+        AST::ASTNode* cond = this->cond(nullptr);
+        while (peek() != t::THEN) {
+            syntax_error();
+            skip_to_leaf(false);
+            cond = this->cond(leaf());
+        }
+        shift();
+        return cond;
+    }
+
+    /* ============ Conditions ============ */
+
+    // and, or:  lowest precedence, grouping to the left.  With 'first',
+    // the first comparison starts with that leaf.
+    AST::ASTNode* DescentParser::cond(AST::ASTNode* first) {
+        AST::ASTNode* left = first ? comparison(first) : unary();
+        for (;;) {
+            int kind = peek();
+            if (kind != t::AND && kind != t::OR) { return left; }
+            shift();
+            AST::ASTNode* right = unary();
+            if (kind == t::AND) {
+                left = new AST::And(*left, *right);
+            } else {
+                left = new AST::Or(*left, *right);
+            }
+        }
+    }
+
+    // not binds tighter than and/or and looser than comparisons.  A
+    // bad start here (states 17, 31, 32 and 52) resumes with a leaf.
+    AST::ASTNode* DescentParser::unary() {
+        size_t nots = 0;
+        for (; peek() == t::NOT; ++nots) { shift(); }
+        AST::ASTNode* operand;
+        if (starts_expr(peek())) {
+            operand = comparison(nullptr);
+        } else {
+            syntax_error();
+            skip_to_leaf(false);
+            operand = comparison(leaf());
+        }
+        for (; nots > 0; --nots) { operand = new AST::Not(*operand); }
+        return operand;
+    }
+
+    // Comparisons don't associate:  after a < b, another < is an error,
+    // which the if or elif finds because it isn't THEN.
+    AST::ASTNode* DescentParser::comparison(AST::ASTNode* first) {
+        AST::ASTNode* left = expr(first);
+        int kind = peek();
+        switch (kind) {
+            case t::LESS: case t::GREATER: case t::ATMOST: case t::ATLEAST: case t::EQUALS:
+                break;
+            default:
+                return new AST::AsBool(*left);
+        }
+        shift();
+        AST::ASTNode* right = expr(nullptr);
+        switch (kind) {
+            case t::LESS: return new AST::Less(*left, *right);
+            case t::GREATER: return new AST::Greater(*left, *right);
+            case t::ATMOST: return new AST::AtMost(*left, *right);
+            case t::ATLEAST: return new AST::AtLeast(*left, *right);
+            default: return new AST::Equals(*left, *right);
+        }
+    }
+
+    /* ============ Expressions ============ */
+
+    // Left operands wait on pending_ with their operator until what
+    // binds tighter on their right is done, so operators group to the
+    // left.  Everything after an open parenthesis is combined at the
+    // ')'; if that isn't there (state 20), Bison resumes with a leaf as
+    // the whole expression in the parentheses.
+    AST::ASTNode* DescentParser::expr(AST::ASTNode* first) {
+        size_t base = pending_.size();
+        AST::ASTNode* right = first ? first : operand();
+        for (;;) {
+            int kind = peek();
+            int prec = precedence(kind);
+            if (prec > 0) {
+                right = reduce(right, base, prec);
+                shift();
+                pending_.push_back(std::make_pair(right, kind));
+                right = operand();
+                continue;
+            }
+            right = reduce(right, base, 1);
+            if (pending_.size() == base) { return right; }
+            if (kind == t::RPAREN) {
+                shift();
+                pending_.pop_back();
+            } else {
+                syntax_error();
+                skip_to_leaf(false);
+                right = leaf();
+            }
+        }
+    }
+
+    // Give the waiting operators of at least min_prec their right
+    // operands, back to the nearest open parenthesis.
+    AST::ASTNode* DescentParser::reduce(AST::ASTNode* right, size_t base, int min_prec) {
+        while (pending_.size() > base) {
+            AST::ASTNode* left = pending_.back().first;
+            int kind = pending_.back().second;
+            if (kind == t::LPAREN || precedence(kind) < min_prec) { break; }
+            pending_.pop_back();
+            switch (kind) {
+                case t::PLUS: right = AST::NodeFactory::binop<AST::Plus>(*left, *right); break;
+                case t::MINUS: right = AST::NodeFactory::binop<AST::Minus>(*left, *right); break;
+                case t::TIMES: right = AST::NodeFactory::binop<AST::Times>(*left, *right); break;
+                default: right = AST::NodeFactory::binop<AST::Div>(*left, *right); break;
+            }
+        }
+        return right;
+    }
+
+    // Any open parentheses, then a leaf.  A bad operand (states 5, 15,
+    // 23 to 26 and 33 to 37) resumes with a leaf in its place.
+    AST::ASTNode* DescentParser::operand() {
+        while (peek() == t::LPAREN) {
+            shift();
+            pending_.push_back(std::make_pair(nullptr, t::LPAREN));
+        }
+        int kind = peek();
+        if (kind != t::IDENT && kind != t::NUMBER) {
+            syntax_error();
+            skip_to_leaf(false);
+        }
+        return leaf();
+    }
+
+    AST::ASTNode* DescentParser::leaf() {
+        AST::ASTNode* leaf;
+        if (peek() == t::NUMBER) {
+            leaf = AST::NodeFactory::constant(value_.num);
+        } else {
+            leaf = AST::NodeFactory::ident(std::string(value_.str));
+            free(value_.str);
+        }
+        shift();
+        return leaf;
+    }
+
+}
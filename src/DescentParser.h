@@ -0,0 +1,93 @@
+//
+// A hand-written parser (parser -d) for the grammar in calc.yxx:
+// descent through statements and blocks, and operator precedence for
+// expressions and conditions.  It builds the same tree the Bison
+// parser builds, node for node and in the same order, and it can
+// stand in for yy::parser anywhere (same constructor, same parse()),
+// but it doesn't interpret LALR tables or keep a stack of %union
+// values.
+//
+// Nothing nests on the machine stack:  the ifs we are inside, and the
+// operators and parentheses still waiting for their right operands,
+// are kept in vectors, and a run of nots is counted.  So, as with
+// Bison's stack, how deep a program may nest is limited only by memory.
+//
+// Syntax errors are reported and recovered from exactly as the Bison
+// parser does it, with its two error rules (IF error FI, and error
+// leaf), so the messages are the same too.  Bison's default
+// reductions mean that an error is always noticed in one of a few
+// places:  where an operand or a statement should start, after a
+// complete statement in a block, or after the condition of an if or
+// elif or the expression in parentheses.  Each of those places knows
+// where Bison would resume, so there is never more than the current
+// expression or condition to throw away.
+//
+
+#ifndef AST_DESCENTPARSER_H
+#define AST_DESCENTPARSER_H
+
+#include "calc.tab.hxx"
+#include "TokenSource.h"
+#include <utility>
+#include <vector>
+
+namespace yy {
+
+    class DescentParser {
+        TokenSource& lexer_;
+        AST::ASTNode** root_;
+
+        /* The lookahead, if we have read it */
+        int kind_;
+        parser::semantic_type value_;
+        location loc_;       // Kept at the end of input, as in Bison
+        int errstatus_;      // As Bison's yyerrstatus_:  3 just after an error
+
+        /* Which tokens may follow the statements of a block */
+        enum Follow { END_OF_INPUT, ELSE_ELIF_FI, FI_ONLY };
+
+        /* A block we are in:  the whole program, or a part of an if */
+        struct Frame {
+            AST::Block* block;   // nullptr until its first statement
+            Follow follow;
+            size_t arms;         // Where the if's arms start in arms_
+        };
+        std::vector<Frame> frames_;
+
+        /* The condition and then part of each if and elif we are in */
+        std::vector<std::pair<AST::ASTNode*, AST::Block*>> arms_;
+
+        /* Left operands waiting for their right operand, with the
+         * operator, and open parentheses (nullptr, LPAREN).
+         */
+        std::vector<std::pair<AST::ASTNode*, int>> pending_;
+
+        int peek();
+        void shift();
+        void discard();
+        void syntax_error();
+        void skip_to_leaf(bool or_fi);
+
+        void program();
+        void append(AST::ASTNode* stmt);
+        void end_if();
+        AST::ASTNode* stmt();
+        AST::ASTNode* if_cond();
+        AST::ASTNode* elif_cond();
+        AST::ASTNode* cond(AST::ASTNode* first);
+        AST::ASTNode* unary();
+        AST::ASTNode* comparison(AST::ASTNode* first);
+        AST::ASTNode* expr(AST::ASTNode* first);
+        AST::ASTNode* operand();
+        AST::ASTNode* reduce(AST::ASTNode* right, size_t base, int min_prec);
+        AST::ASTNode* leaf();
+    public:
+        DescentParser(TokenSource& lexer, AST::ASTNode** root) : lexer_(lexer), root_(root) {}
+
+        /* 0 if the parse succeeded, 1 if it gave up, as yy::parser::parse */
+        int parse();
+    };
+
+}
+
+#endif //AST_DESCENTPARSER_H
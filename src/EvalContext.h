@@ -8,16 +8,31 @@
 #ifndef AST_EVALCONTEXT_H
 #define AST_EVALCONTEXT_H
 
+#include <stdexcept>
+#include <string>
 #include <unordered_map>
 
+namespace AST { class Profile; }
+
 // EvalContext is really just a struct for passing around the
 // context.  There is no attempt at information hiding here.
 //
 class EvalContext {
 public:
     std::unordered_map<std::string,int> symtab;
+    AST::Profile* profile = nullptr;   // Counting executions?  (parser -p)
+    bool checked_division = false;     // Throw DivisionError rather than trap?
     explicit EvalContext() { }
 };
 
+// Division by zero, or of INT_MIN by -1, which the hardware traps on.
+// Only thrown when checked_division is set, as in server mode, where
+// one bad request must not take the whole process down.
+//
+class DivisionError : public std::runtime_error {
+public:
+    explicit DivisionError(const std::string& what) : std::runtime_error(what) {}
+};
+
 
 #endif //AST_EVALCONTEXT_H
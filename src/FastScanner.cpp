@@ -0,0 +1,293 @@
+//
+// Fast scanner; see FastScanner.h
+//
+
+#include "FastScanner.h"
+#include "Messages.h"
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(SCANNER_AVX2)
+#include <immintrin.h>
+#elif defined(SCANNER_SSE2)
+#include <emmintrin.h>
+#endif
+
+namespace yy {
+
+    // The buffer has this many '\0's after the input, so that we can
+    // always read a whole chunk, and so that every scan stops at the end
+    static const int padding = 64;
+
+    static inline bool is_digit(char c) { return c >= '0' && c <= '9'; }
+    static inline bool is_word(char c) {
+        return is_digit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+    }
+
+    /* ============ Character classes, a chunk at a time ============ */
+
+    // Masks have bit i set if p[i] is in the class.  Bytes of 0x80 and
+    // up are negative as signed chars, so no range test takes them.
+
+#if defined(SCANNER_AVX2)
+    static const int chunk = 32;
+    static const uint32_t full = 0xffffffffu;
+    typedef __m256i Vec;
+    static inline Vec load(const char* p) { return _mm256_loadu_si256((const Vec*) p); }
+    static inline Vec splat(char c) { return _mm256_set1_epi8(c); }
+    static inline Vec eq(Vec a, Vec b) { return _mm256_cmpeq_epi8(a, b); }
+    static inline Vec gt(Vec a, Vec b) { return _mm256_cmpgt_epi8(a, b); }
+    static inline Vec both(Vec a, Vec b) { return _mm256_and_si256(a, b); }
+    static inline Vec either(Vec a, Vec b) { return _mm256_or_si256(a, b); }
+    static inline uint32_t bits(Vec v) { return (uint32_t) _mm256_movemask_epi8(v); }
+#elif defined(SCANNER_SSE2)
+    static const int chunk = 16;
+    static const uint32_t full = 0xffffu;
+    typedef __m128i Vec;
+    static inline Vec load(const char* p) { return _mm_loadu_si128((const Vec*) p); }
+    static inline Vec splat(char c) { return _mm_set1_epi8(c); }
+    static inline Vec eq(Vec a, Vec b) { return _mm_cmpeq_epi8(a, b); }
+    static inline Vec gt(Vec a, Vec b) { return _mm_cmpgt_epi8(a, b); }
+    static inline Vec both(Vec a, Vec b) { return _mm_and_si128(a, b); }
+    static inline Vec either(Vec a, Vec b) { return _mm_or_si128(a, b); }
+    static inline uint32_t bits(Vec v) { return (uint32_t) _mm_movemask_epi8(v); }
+#endif
+
+#if defined(SCANNER_AVX2) || defined(SCANNER_SSE2)
+    static inline Vec in_range(Vec c, char lo, char hi) {
+        return both(gt(c, splat(lo - 1)), gt(splat(hi + 1), c));
+    }
+
+    static inline void space_classes(const char* p, uint32_t& space, uint32_t& newline) {
+        Vec c = load(p);
+        Vec nl = eq(c, splat('\n'));
+        newline = bits(nl);
+        space = bits(either(nl, eq(c, splat(' '))));
+    }
+
+    static inline void word_classes(const char* p, uint32_t& word, uint32_t& digit) {
+        Vec c = load(p);
+        Vec digits = in_range(c, '0', '9');
+        Vec letters = in_range(either(c, splat(0x20)), 'a', 'z');  // 0x20 makes upper case lower
+        digit = bits(digits);
+        word = bits(either(either(digits, letters), eq(c, splat('_'))));
+    }
+
+    // All the bits below the lowest one set in stop, or all of them
+    static inline uint32_t before(uint32_t stop) {
+        return stop ? (stop & (0u - stop)) - 1 : full;
+    }
+
+    // Most white space is a single blank between tokens, and most words
+    // are short, so look at a character or two before loading a chunk
+
+    void FastScanner::skip_space() {
+        const char* p = p_;
+        if (*p != ' ' && *p != '\n') { return; }
+        if (*p == ' ' && p[1] != ' ' && p[1] != '\n') {
+            p_ = p + 1;
+            return;
+        }
+        for (;;) {
+            uint32_t space, newline;
+            space_classes(p, space, newline);
+            uint32_t stop = ~space & full;
+            uint32_t passed = newline & before(stop);
+            if (passed) {
+                line_ += __builtin_popcount(passed);
+                line_start_ = p + (31 - __builtin_clz(passed)) + 1;
+                plain_ = true;
+            }
+            if (stop) {
+                p_ = p + __builtin_ctz(stop);
+                return;
+            }
+            p += chunk;
+        }
+    }
+
+    const char* FastScanner::word_end(const char* p, bool& digits) const {
+        for (int i = 0; i < 4; ++i, ++p) {
+            if (! is_word(*p)) { return p; }
+            if (! is_digit(*p)) { digits = false; }
+        }
+        for (;;) {
+            uint32_t word, digit;
+            word_classes(p, word, digit);
+            uint32_t stop = ~word & full;
+            uint32_t run = before(stop);
+            if ((digit & run) != run) { digits = false; }
+            if (stop) { return p + __builtin_ctz(stop); }
+            p += chunk;
+        }
+    }
+
+    const char* FastScanner::simd() {
+        return chunk == 32 ? "AVX2" : "SSE2";
+    }
+#else
+    void FastScanner::skip_space() {
+        const char* p = p_;
+        while (*p == ' ' || *p == '\n') {
+            if (*p == '\n') {
+                ++line_;
+                line_start_ = p + 1;
+                plain_ = true;
+            }
+            ++p;
+        }
+        p_ = p;
+    }
+
+    const char* FastScanner::word_end(const char* p, bool& digits) const {
+        while (is_word(*p)) {
+            if (! is_digit(*p)) { digits = false; }
+            ++p;
+        }
+        return p;
+    }
+
+    const char* FastScanner::simd() { return "scalar"; }
+#endif
+
+    /* ============ Keywords ============ */
+
+    // (first * 4 + last + length) % 16 is different for each keyword
+    struct Keyword {
+        const char* word;
+        int length;
+        int kind;
+    };
+    static const Keyword keywords[16] = {
+        {"or", 2, parser::token::OR}, {nullptr, 0, 0},
+        {"then", 4, parser::token::THEN}, {"fi", 2, parser::token::FI},
+        {nullptr, 0, 0}, {nullptr, 0, 0}, {nullptr, 0, 0}, {nullptr, 0, 0},
+        {nullptr, 0, 0}, {nullptr, 0, 0}, {nullptr, 0, 0},
+        {"and", 3, parser::token::AND}, {"if", 2, parser::token::IF},
+        {"else", 4, parser::token::ELSE}, {"elif", 4, parser::token::ELIF},
+        {"not", 3, parser::token::NOT}
+    };
+
+    static int keyword(const char* text, int length) {
+        if (length < 2 || length > 4) { return 0; }
+        const Keyword& k = keywords[(text[0] * 4 + text[length - 1] + length) & 15];
+        if (k.length != length || memcmp(k.word, text, length) != 0) { return 0; }
+        return k.kind;
+    }
+
+    /* ============ Input ============ */
+
+    FastScanner::FastScanner(FILE* in) {
+        char block[1 << 16];
+        size_t n;
+        while ((n = fread(block, 1, sizeof block, in)) > 0) {
+            buf_.append(block, n);
+        }
+        start();
+    }
+
+    FastScanner::FastScanner(std::istream& in) {
+        char block[1 << 16];
+        while (in.read(block, sizeof block) || in.gcount() > 0) {
+            buf_.append(block, in.gcount());
+        }
+        start();
+    }
+
+    FastScanner::FastScanner(const std::string& text) : buf_{text} {
+        start();
+    }
+
+    void FastScanner::start() {
+        size_t size = buf_.size();
+        buf_.append(padding, '\0');
+        p_ = buf_.data();
+        end_ = p_ + size;
+        line_start_ = p_;
+        line_ = 1;
+        plain_ = true;
+    }
+
+    /* ============ Tokens ============ */
+
+    // Like reflex's columno():  tabs go to the next multiple of 8, and
+    // UTF-8 continuation bytes don't count
+    int FastScanner::wide_column(const char* p) const {
+        int n = 0;
+        for (const char* c = line_start_; c < p; ++c) {
+            if (*c == '\t') { n += 1 + (~n & 7); }
+            else if ((*c & 0xC0) != 0x80) { ++n; }
+        }
+        return n;
+    }
+
+    // Locations are as reflex gives them:  lines from 1, columns from 0,
+    // and the end is the column of the last character.
+    int FastScanner::token(int kind, const char* start, location* yylloc) {
+        yylloc->begin.line = line_;
+        yylloc->begin.column = column(start);
+        yylloc->end.line = line_;
+        yylloc->end.column = column(p_) - 1;
+        return kind;
+    }
+
+    int FastScanner::yylex(parser::semantic_type* yylval, location* yylloc) {
+        typedef parser::token t;
+        governor::charge_token();
+        for (;;) {
+            skip_space();
+            const char* start = p_;
+            if (start >= end_) { return 0; }
+            if (is_word(*start)) {
+                bool digits = true;
+                p_ = word_end(start, digits);
+                int length = (int) (p_ - start);
+                if (digits) {
+                    long value = 0;
+                    for (const char* d = start; d < p_ && value <= INT_MAX; ++d) {
+                        value = value * 10 + (*d - '0');
+                    }
+                    if (value > INT_MAX) {
+                        report::error("Integer literal too large at line " + std::to_string(line_) +
+                                      ", column " + std::to_string(column(start)));
+                        value = 0;
+                    }
+                    yylval->num = (int) value;
+                    return token(t::NUMBER, start, yylloc);
+                }
+                if (int kind = keyword(start, length)) {
+                    return token(kind, start, yylloc);
+                }
+                char* text = (char*) malloc(length + 1);
+                memcpy(text, start, length);
+                text[length] = '\0';
+                yylval->str = text;
+                return token(t::IDENT, start, yylloc);
+            }
+            char c = *p_++;
+            bool eq = p_ < end_ && *p_ == '=';
+            switch (c) {
+                case '+': return token(t::PLUS, start, yylloc);
+                case '-': return token(t::MINUS, start, yylloc);
+                case '*': return token(t::TIMES, start, yylloc);
+                case '/': return token(t::DIV, start, yylloc);
+                case '(': return token(t::LPAREN, start, yylloc);
+                case ')': return token(t::RPAREN, start, yylloc);
+                case '<': if (eq) { ++p_; return token(t::ATMOST, start, yylloc); }
+                          return token(t::LESS, start, yylloc);
+                case '>': if (eq) { ++p_; return token(t::ATLEAST, start, yylloc); }
+                          return token(t::GREATER, start, yylloc);
+                case '=': if (eq) { ++p_; return token(t::EQUALS, start, yylloc); }
+                          return token(t::GETS, start, yylloc);
+            }
+            if (c == '\t' || (c & 0x80)) { plain_ = false; }
+            // The text of a '\0' is an empty C string
+            report::error("Unexpected character '" + (c ? std::string(1, c) : std::string()) + "'" +
+                          " at line " + std::to_string(line_) +
+                          ", column " + std::to_string(column(start)));
+        }
+    }
+
+}
@@ -0,0 +1,60 @@
+//
+// A hand-written scanner (parser -F), for very large inputs, that
+// produces the same tokens, semantic values, locations and error
+// messages as the one reflex generates from calc.lxx.
+//
+// The reflex scanner matches white space one character at a time and
+// converts each number with strtol.  This one reads the whole input
+// into one buffer and finds the ends of runs of white space and of
+// identifiers and numbers 16 or 32 characters at a time, by testing
+// character classes with SSE2 or AVX2 and looking at the bit masks.
+// Keywords are found with a perfect hash on the length and the first
+// and last characters, and number values accumulate as we go.
+//
+// Which instructions to use is decided when the build is configured
+// (SCANNER_SIMD in CMakeLists.txt), with a plain loop when the machine
+// has neither.  Columns are counted as reflex counts them, with tab
+// stops every 8 and UTF-8 characters as one column; since tabs and
+// non-ASCII bytes are errors here anyway, that only costs anything on
+// lines that have them.  Identifiers are still strdup'ed (well, malloc'ed and
+// copied), because the parser owns and frees them.
+//
+
+#ifndef AST_FASTSCANNER_H
+#define AST_FASTSCANNER_H
+
+#include "TokenSource.h"
+#include <cstdio>
+#include <istream>
+#include <string>
+
+namespace yy {
+
+    class FastScanner : public TokenSource {
+        std::string buf_;          // The whole input, then padding
+        const char* p_;            // Next character to scan
+        const char* end_;          // End of the input proper
+        const char* line_start_;   // First character of the current line
+        int line_;
+        bool plain_;               // No tabs or non-ASCII so far on this line
+
+        void start();
+        void skip_space();
+        const char* word_end(const char* p, bool& digits) const;
+        int column(const char* p) const { return plain_ ? (int) (p - line_start_) : wide_column(p); }
+        int wide_column(const char* p) const;
+
+        int token(int kind, const char* start, location* yylloc);
+    public:
+        explicit FastScanner(FILE* in);
+        explicit FastScanner(std::istream& in);
+        explicit FastScanner(const std::string& text);
+        int yylex(parser::semantic_type* yylval, location* yylloc) override;
+
+        /* "AVX2", "SSE2" or "scalar", as configured */
+        static const char* simd();
+    };
+
+}
+
+#endif //AST_FASTSCANNER_H
@@ -0,0 +1,100 @@
+//
+// Resource governor; see Governor.h
+//
+
+#include "Governor.h"
+#include "ASTNode.h"
+#include <climits>
+#include <cstdlib>
+#include <utility>
+#include <vector>
+
+namespace governor {
+
+    // How many ticks between looks at the clock
+    static const int ticks_per_check = 4096;
+
+    static Limits current;
+    static std::chrono::steady_clock::time_point deadline;
+
+    long tokens_left_ = LONG_MAX;
+    long nodes_left_ = LONG_MAX;
+    thread_local int ticks_left_ = ticks_per_check;
+
+    static long or_unlimited(long limit) {
+        return limit > 0 ? limit : LONG_MAX;
+    }
+
+    bool set_limit(Limits& limits, const std::string& setting) {
+        size_t eq = setting.find('=');
+        if (eq == std::string::npos) { return false; }
+        std::string name = setting.substr(0, eq);
+        char* end;
+        long value = strtol(setting.c_str() + eq + 1, &end, 10);
+        if (*end != '\0' || end == setting.c_str() + eq + 1 || value < 0) { return false; }
+        if (name == "tokens") { limits.tokens = value; }
+        else if (name == "nodes") { limits.nodes = value; }
+        else if (name == "depth") { limits.depth = value; }
+        else if (name == "time") { limits.millis = value; }
+        else if (name == "output") { limits.output_bytes = value; }
+        else { return false; }
+        return true;
+    }
+
+    void start(const Limits& limits) {
+        current = limits;
+        tokens_left_ = or_unlimited(limits.tokens);
+        nodes_left_ = or_unlimited(limits.nodes);
+        deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(limits.millis);
+        ticks_left_ = ticks_per_check;
+    }
+
+    const Limits& limits() { return current; }
+
+    void over_token_limit() { throw LimitExceeded("tokens", current.tokens); }
+    void over_node_limit() { throw LimitExceeded("nodes", current.nodes); }
+
+    void check_clock() {
+        ticks_left_ = ticks_per_check;
+        if (current.millis > 0 && std::chrono::steady_clock::now() > deadline) {
+            throw LimitExceeded("time", current.millis);
+        }
+    }
+
+    void check_depth(AST::ASTNode& root) {
+        if (current.depth <= 0) { return; }
+        std::vector<std::pair<AST::ASTNode*, long>> work{{&root, 1}};
+        std::vector<AST::ASTNode*> kids;
+        while (! work.empty()) {
+            AST::ASTNode* node = work.back().first;
+            long depth = work.back().second;
+            work.pop_back();
+            if (depth > current.depth) { throw LimitExceeded("depth", current.depth); }
+            kids.clear();
+            node->children(kids);
+            for (AST::ASTNode* kid : kids) { work.push_back(std::make_pair(kid, depth + 1)); }
+        }
+    }
+
+    void LimitedBuf::reset() {
+        left_ = or_unlimited(current.output_bytes);
+    }
+
+    void LimitedBuf::charge(std::streamsize n) {
+        left_ -= n;
+        if (left_ < 0) { throw LimitExceeded("output", current.output_bytes); }
+        tick();
+    }
+
+    int LimitedBuf::overflow(int c) {
+        if (c == traits_type::eof()) { return traits_type::not_eof(c); }
+        charge(1);
+        return out_->sputc(traits_type::to_char_type(c));
+    }
+
+    std::streamsize LimitedBuf::xsputn(const char* s, std::streamsize n) {
+        charge(n);
+        return out_->sputn(s, n);
+    }
+
+}
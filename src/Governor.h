@@ -0,0 +1,104 @@
+//
+// Resource governor, for programs we don't trust (parser -L).
+//
+// Limits on how many tokens the scanner may produce, how many AST
+// nodes the parser may build and how deep the tree may be, how long
+// the whole run may take, and how many bytes of output we may write.
+// Going over a limit throws governor::LimitExceeded, which says which
+// limit it was, so that the driver (or the server, for one request)
+// can fail cleanly instead of running out of memory, stack or time.
+// So does reaching the error limit in report::bail.
+//
+// A limit of 0 means no limit, and by default there are none.  The
+// checks are a counter and a compare; the clock is only read every
+// few thousand ticks.
+//
+
+#ifndef AST_GOVERNOR_H
+#define AST_GOVERNOR_H
+
+#include <chrono>
+#include <ostream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+
+namespace AST { class ASTNode; }
+
+namespace governor {
+
+    struct Limits {
+        long tokens = 0;
+        long nodes = 0;
+        long depth = 0;         // Of the AST
+        long millis = 0;        // Wall time, from start()
+        long output_bytes = 0;
+    };
+
+    class LimitExceeded : public std::runtime_error {
+    public:
+        const std::string resource;
+        const long limit;
+        LimitExceeded(std::string resource, long limit) :
+            std::runtime_error("limit exceeded: " + resource + " (limit " + std::to_string(limit) + ")"),
+            resource{resource}, limit{limit} {}
+    };
+
+    /* Set one limit from "name=value", where name is tokens, nodes,
+     * depth, time (milliseconds) or output (bytes).  False if malformed.
+     */
+    bool set_limit(Limits& limits, const std::string& setting);
+
+    /* Use these limits, starting the counts and the clock over */
+    void start(const Limits& limits);
+    const Limits& limits();
+
+    /* Counts and the clock are kept here; use the functions below. */
+    extern long tokens_left_;
+    extern long nodes_left_;
+    extern thread_local int ticks_left_;
+    void over_token_limit();
+    void over_node_limit();
+    void check_clock();
+
+    /* A unit of work, e.g., evaluating a node; every so often we look at the clock */
+    inline void tick() {
+        if (--ticks_left_ <= 0) { check_clock(); }
+    }
+    /* The scanner produced a token */
+    inline void charge_token() {
+        if (--tokens_left_ < 0) { over_token_limit(); }
+        tick();
+    }
+    /* The parser (or a pass over the tree) built a node */
+    inline void charge_node() {
+        if (--nodes_left_ < 0) { over_node_limit(); }
+        tick();
+    }
+
+    /* Throw if the tree is deeper than the limit.  Walks the tree
+     * without recursion, so it's safe on a tree too deep for the
+     * recursive walks (eval, json, code generation) we want to protect.
+     */
+    void check_depth(AST::ASTNode& root);
+
+    /* Passes output along to another stream buffer, throwing when
+     * the output limit is reached.  The stream using it must have
+     * exceptions(std::ios::badbit) so that the exception gets out.
+     */
+    class LimitedBuf : public std::streambuf {
+        std::streambuf* out_;
+        long left_;
+        void charge(std::streamsize n);
+    protected:
+        int overflow(int c) override;
+        std::streamsize xsputn(const char* s, std::streamsize n) override;
+        int sync() override { return out_->pubsync(); }
+    public:
+        explicit LimitedBuf(std::streambuf* out) : out_{out}, left_{0} { reset(); }
+        void reset();    // Start counting over, with the current limit
+    };
+
+}
+
+#endif //AST_GOVERNOR_H
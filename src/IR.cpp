@@ -0,0 +1,237 @@
+//
+// SSA intermediate representation; see IR.h
+//
+
+#include "IR.h"
+#include <set>
+
+namespace ir {
+
+    const char* op_name(Op op) {
+        switch (op) {
+            case Const: return "const";
+            case Add: return "add";
+            case Sub: return "sub";
+            case Mul: return "mul";
+            case Div: return "div";
+            case Less: return "lt";
+            case AtMost: return "le";
+            case Greater: return "gt";
+            case AtLeast: return "ge";
+            case Equals: return "eq";
+            case Phi: return "phi";
+        }
+        return "?";
+    }
+
+    bool is_compare(Op op) {
+        return op == Less || op == AtMost || op == Greater || op == AtLeast || op == Equals;
+    }
+
+    Instr* resolve(Instr* value) {
+        while (value->forward != nullptr) { value = value->forward; }
+        return value;
+    }
+
+    void remove_edge(BasicBlock* from, BasicBlock* to) {
+        for (size_t k = 0; k < to->preds.size(); ++k) {
+            if (to->preds[k] != from) { continue; }
+            to->preds.erase(to->preds.begin() + k);
+            for (Instr* instr : to->instrs) {
+                if (instr->op == Phi) { instr->args.erase(instr->args.begin() + k); }
+            }
+            break;
+        }
+        for (auto it = from->succs.begin(); it != from->succs.end(); ++it) {
+            if (*it == to) {
+                from->succs.erase(it);
+                break;
+            }
+        }
+    }
+
+    Function::~Function() {
+        for (BasicBlock* block : blocks) { delete block; }
+        for (Instr* instr : instrs_) { delete instr; }
+    }
+
+    Instr* Function::make(Op op, BasicBlock* block, int imm) {
+        Instr* instr = new Instr(++next_value_, op, imm, block);
+        block->instrs.push_back(instr);
+        instrs_.push_back(instr);
+        return instr;
+    }
+
+    BasicBlock* Function::new_block(std::string prefix) {
+        int id = next_block_++;
+        BasicBlock* block = new BasicBlock(id, prefix + "_" + std::to_string(id));
+        blocks.push_back(block);
+        return block;
+    }
+
+    /* The caller has already disconnected the block */
+    void Function::delete_block(BasicBlock* block) {
+        for (auto it = blocks.begin(); it != blocks.end(); ++it) {
+            if (*it == block) {
+                blocks.erase(it);
+                break;
+            }
+        }
+        delete block;
+    }
+
+    /* Successors are visited last to first, so that in the final
+     * order a 'then' part comes before its 'else' part.
+     */
+    void Function::layout() {
+        std::vector<BasicBlock*> postorder;
+        std::set<BasicBlock*> visited;
+        std::vector<std::pair<BasicBlock*, size_t>> stack;
+        stack.push_back(std::make_pair(blocks[0], blocks[0]->succs.size()));
+        visited.insert(blocks[0]);
+        while (! stack.empty()) {
+            auto& top = stack.back();
+            if (top.second == 0) {
+                postorder.push_back(top.first);
+                stack.pop_back();
+                continue;
+            }
+            BasicBlock* succ = top.first->succs[--top.second];
+            if (visited.insert(succ).second) {
+                stack.push_back(std::make_pair(succ, succ->succs.size()));
+            }
+        }
+        for (BasicBlock* block : blocks) {
+            if (visited.count(block) != 0) { continue; }
+            while (! block->succs.empty()) { remove_edge(block, block->succs[0]); }
+        }
+        for (BasicBlock* block : blocks) {
+            if (visited.count(block) == 0) { delete block; }
+        }
+        blocks.assign(postorder.rbegin(), postorder.rend());
+    }
+
+    /* Textual form, one instruction per line:
+     *    then_1:   ; preds entry_0
+     *      v4 = add v2, v3
+     *      jump endif_3
+     */
+    void Function::dump(std::ostream& out) {
+        for (BasicBlock* block : blocks) {
+            out << block->name << ":";
+            if (! block->preds.empty()) {
+                out << "\t\t; preds";
+                for (BasicBlock* pred : block->preds) { out << " " << pred->name; }
+            }
+            out << std::endl;
+            for (Instr* instr : block->instrs) {
+                out << "    v" << instr->id << " = " << op_name(instr->op);
+                if (instr->op == Const) {
+                    out << " " << instr->imm;
+                }
+                auto sep = " ";
+                for (size_t i = 0; i < instr->args.size(); ++i) {
+                    out << sep << "v" << resolve(instr->args[i])->id;
+                    if (instr->op == Phi) { out << " from " << block->preds[i]->name; }
+                    sep = ", ";
+                }
+                out << std::endl;
+            }
+            switch (block->term) {
+                case BasicBlock::Jump:
+                    out << "    jump " << block->succs[0]->name << std::endl;
+                    break;
+                case BasicBlock::Branch:
+                    out << "    branch v" << resolve(block->value)->id << ", "
+                        << block->succs[0]->name << ", " << block->succs[1]->name << std::endl;
+                    break;
+                case BasicBlock::Return:
+                    out << "    return v" << resolve(block->value)->id << std::endl;
+                    break;
+            }
+        }
+    }
+
+    /* ============ Building the IR from the AST ============ */
+
+    Builder::Builder(Function& fn) : fn_{fn} {
+        current = fn_.new_block("entry");
+    }
+
+    /* Constants all go in the entry block, which dominates
+     * everything, so that any block can use them.
+     */
+    Instr* Builder::constant(int value) {
+        Instr*& instr = constants_[value];
+        if (instr == nullptr) {
+            instr = fn_.make(Const, fn_.blocks[0], value);
+        }
+        return instr;
+    }
+
+    Instr* Builder::binary(Op op, Instr* left, Instr* right) {
+        Instr* instr = fn_.make(op, current);
+        instr->args.push_back(left);
+        instr->args.push_back(right);
+        return instr;
+    }
+
+    Instr* Builder::read(const std::string& var) {
+        auto found = vars.find(var);
+        if (found == vars.end()) { return constant(0); }
+        return found->second;
+    }
+
+    void Builder::jump(BasicBlock* target) {
+        current->term = BasicBlock::Jump;
+        current->succs.push_back(target);
+        target->preds.push_back(current);
+    }
+
+    void Builder::branch(Instr* cond, BasicBlock* if_true, BasicBlock* if_false) {
+        current->term = BasicBlock::Branch;
+        current->value = cond;
+        current->succs.push_back(if_true);
+        current->succs.push_back(if_false);
+        if_true->preds.push_back(current);
+        if_false->preds.push_back(current);
+    }
+
+    void Builder::ret(Instr* value) {
+        current->term = BasicBlock::Return;
+        current->value = value;
+    }
+
+    /* envs and values are in the same order as join->preds,
+     * i.e., the order in which the predecessors jumped to join.
+     */
+    Instr* Builder::join(BasicBlock* join, const std::vector<Env>& envs,
+                         const std::vector<Instr*>& values) {
+        set_block(join);
+        auto merge = [&](const std::vector<Instr*>& incoming) {
+            for (Instr* value : incoming) {
+                if (value != incoming[0]) {
+                    Instr* phi = fn_.make(Phi, join);
+                    phi->args = incoming;
+                    return phi;
+                }
+            }
+            return incoming[0];
+        };
+        std::set<std::string> names;
+        for (const Env& env : envs) {
+            for (auto& binding : env) { names.insert(binding.first); }
+        }
+        vars.clear();
+        for (const std::string& name : names) {
+            std::vector<Instr*> incoming;
+            for (const Env& env : envs) {
+                auto found = env.find(name);
+                incoming.push_back(found == env.end() ? constant(0) : found->second);
+            }
+            vars[name] = merge(incoming);
+        }
+        return merge(values);
+    }
+
+}
@@ -0,0 +1,129 @@
+//
+// An intermediate representation between the AST and the code
+// generators:  basic blocks of instructions in static single
+// assignment (SSA) form.
+//
+// Each instruction computes one value, and each value is computed by
+// exactly one instruction, so an instruction *is* its value; operands
+// are just pointers to other instructions.  Where control flow joins
+// (at the end of an 'if'), a phi instruction picks the value that
+// arrived along the edge we came in on.  Since the calculator has
+// no loops, the control flow graph is acyclic, and the blocks are
+// kept in an order where every edge points forward.
+//
+// Optimizations written against the IR (see IROptimize.cpp) work for
+// every backend that consumes it, instead of being written once for
+// eval, once for gen_rvalue, and once for gen_branch.
+//
+
+#ifndef AST_IR_H
+#define AST_IR_H
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace ir {
+
+    enum Op {
+        Const,                  // imm
+        Add, Sub, Mul, Div,     // args[0] op args[1]
+        Less, AtMost, Greater, AtLeast, Equals,   // 1 or 0
+        Phi                     // args[i] came from block->preds[i]
+    };
+
+    const char* op_name(Op op);
+    bool is_compare(Op op);
+
+    struct BasicBlock;
+
+    struct Instr {
+        int id;                     // Printed as v<id>
+        Op op;
+        int imm;                    // Value of a Const
+        std::vector<Instr*> args;
+        BasicBlock* block;
+        Instr* forward;             // Replaced by this value (see resolve)
+        Instr(int id, Op op, int imm, BasicBlock* block) :
+            id{id}, op{op}, imm{imm}, block{block}, forward{nullptr} {}
+    };
+
+    /* After an optimization decides one value can be replaced
+     * by another, uses are redirected lazily by following 'forward'.
+     */
+    Instr* resolve(Instr* value);
+
+    struct BasicBlock {
+        enum Terminator { Jump, Branch, Return };
+        int id;
+        std::string name;
+        std::vector<Instr*> instrs;   // Phis first
+        Terminator term;
+        Instr* value;                 // Branch: condition (non-zero -> succs[0]).  Return: result
+        std::vector<BasicBlock*> succs;
+        std::vector<BasicBlock*> preds;
+        BasicBlock(int id, std::string name) :
+            id{id}, name{name}, term{Return}, value{nullptr} {}
+    };
+
+    /* Remove the edge from -> to, and the matching phi arguments in 'to' */
+    void remove_edge(BasicBlock* from, BasicBlock* to);
+
+    class Function {
+        int next_value_ = 0;
+        int next_block_ = 0;
+        std::vector<Instr*> instrs_;       // Including ones optimized away
+    public:
+        std::vector<BasicBlock*> blocks;   // blocks[0] is the entry
+        ~Function();
+        Instr* make(Op op, BasicBlock* block, int imm = 0);
+        BasicBlock* new_block(std::string prefix);
+        void delete_block(BasicBlock* block);
+        /* Put the reachable blocks in reverse postorder (so every edge
+         * points forward) and drop the unreachable ones.
+         */
+        void layout();
+        void dump(std::ostream& out);
+    };
+
+    /* Builds the IR as the AST lowers itself into it.  Keeps track of
+     * the current SSA value of each calculator variable, which is
+     * all the bookkeeping SSA construction needs without loops.
+     */
+    class Builder {
+        Function& fn_;
+        std::map<int, Instr*> constants_;   // One Const per value, in the entry block
+    public:
+        typedef std::map<std::string, Instr*> Env;
+        BasicBlock* current;
+        Env vars;
+
+        explicit Builder(Function& fn);
+
+        Instr* constant(int value);
+        Instr* binary(Op op, Instr* left, Instr* right);
+        Instr* read(const std::string& var);    // Unassigned variables are zero
+        void write(const std::string& var, Instr* value) { vars[var] = value; }
+
+        BasicBlock* new_block(const char* prefix) { return fn_.new_block(prefix); }
+        void set_block(BasicBlock* block) { current = block; }
+        void jump(BasicBlock* target);
+        void branch(Instr* cond, BasicBlock* if_true, BasicBlock* if_false);
+        void ret(Instr* value);
+
+        /* Start block 'join', whose predecessors left the variables
+         * in 'envs' and produced 'values'.  Inserts phis where they
+         * differ and returns the joined value.
+         */
+        Instr* join(BasicBlock* join, const std::vector<Env>& envs,
+                    const std::vector<Instr*>& values);
+    };
+
+    /* Copy propagation, constant propagation and folding, global value
+     * numbering, and dead code elimination, until nothing changes.
+     */
+    void optimize(Function& fn);
+}
+
+#endif //AST_IR_H
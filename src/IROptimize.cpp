@@ -0,0 +1,301 @@
+//
+// Optimizations on the SSA intermediate representation.
+//
+// Because every value has exactly one definition, most of these
+// are simple:  when we discover that a value is the same as some
+// other value, we set its 'forward' pointer and every use sees the
+// other value from then on.
+//
+
+#include "IR.h"
+#include <climits>
+#include <map>
+#include <set>
+#include <tuple>
+
+namespace ir {
+
+    /* Entry block constants, shared, created as folding needs them */
+    static Instr* constant(Function& fn, int value) {
+        BasicBlock* entry = fn.blocks[0];
+        for (Instr* instr : entry->instrs) {
+            if (instr->op == Const && instr->imm == value) { return instr; }
+        }
+        return fn.make(Const, entry, value);
+    }
+
+    static bool is_const(Instr* value, int imm) {
+        return value->op == Const && value->imm == imm;
+    }
+
+    /* Evaluate op on constants, like the calculator would.
+     * False if we'd better leave it for run time (division by zero).
+     */
+    static bool fold(Op op, int left, int right, int& result) {
+        switch (op) {
+            case Add: result = left + right; return true;
+            case Sub: result = left - right; return true;
+            case Mul: result = left * right; return true;
+            case Div:
+                if (right == 0 || (left == INT_MIN && right == -1)) { return false; }
+                result = left / right; return true;
+            case Less: result = left < right; return true;
+            case AtMost: result = left <= right; return true;
+            case Greater: result = left > right; return true;
+            case AtLeast: result = left >= right; return true;
+            case Equals: result = left == right; return true;
+            default: return false;
+        }
+    }
+
+    /* Copy propagation:  A phi whose arguments are all the same value
+     * is just a copy of it, and so are x+0, x-0, x*1, and x/1.
+     */
+    static Instr* copy_of(Instr* instr) {
+        if (instr->op == Phi) {
+            for (Instr* arg : instr->args) {
+                if (arg != instr->args[0]) { return nullptr; }
+            }
+            return instr->args.empty() ? nullptr : instr->args[0];
+        }
+        if (instr->args.size() != 2) { return nullptr; }
+        Instr* left = instr->args[0];
+        Instr* right = instr->args[1];
+        switch (instr->op) {
+            case Add:
+                if (is_const(right, 0)) { return left; }
+                if (is_const(left, 0)) { return right; }
+                return nullptr;
+            case Sub: return is_const(right, 0) ? left : nullptr;
+            case Mul:
+                if (is_const(right, 1)) { return left; }
+                if (is_const(left, 1)) { return right; }
+                return nullptr;
+            case Div: return is_const(right, 1) ? left : nullptr;
+            default: return nullptr;
+        }
+    }
+
+    /* Constant and copy propagation in one pass.  Blocks are in an
+     * order where definitions come before uses, so one pass sees the
+     * results of folding each operand before the instruction that uses it.
+     */
+    static bool propagate(Function& fn) {
+        bool changed = false;
+        for (BasicBlock* block : fn.blocks) {
+            std::vector<Instr*> kept;
+            // Folding can add constants to the entry block as we go
+            for (size_t i = 0; i < block->instrs.size(); ++i) {
+                Instr* instr = block->instrs[i];
+                for (Instr*& arg : instr->args) { arg = resolve(arg); }
+                Instr* same = copy_of(instr);
+                int value;
+                if (same == nullptr && instr->args.size() == 2
+                    && instr->args[0]->op == Const && instr->args[1]->op == Const
+                    && fold(instr->op, instr->args[0]->imm, instr->args[1]->imm, value)) {
+                    same = constant(fn, value);
+                }
+                if (same != nullptr) {
+                    instr->forward = same;
+                    changed = true;
+                } else {
+                    kept.push_back(instr);
+                }
+            }
+            block->instrs = kept;
+            if (block->value != nullptr) { block->value = resolve(block->value); }
+        }
+        return changed;
+    }
+
+    /* A branch on a constant is a jump.  The other arm may
+     * become unreachable, and layout will drop it.
+     */
+    static bool fold_branches(Function& fn) {
+        bool changed = false;
+        for (BasicBlock* block : fn.blocks) {
+            if (block->term != BasicBlock::Branch || block->value->op != Const) { continue; }
+            BasicBlock* untaken = block->succs[block->value->imm ? 1 : 0];
+            remove_edge(block, untaken);
+            block->term = BasicBlock::Jump;
+            block->value = nullptr;
+            changed = true;
+        }
+        if (changed) { fn.layout(); }
+        return changed;
+    }
+
+    /* A block that is the only successor of its only predecessor
+     * can be glued onto the end of the predecessor.
+     */
+    static bool merge_blocks(Function& fn) {
+        bool changed = false;
+        for (size_t i = 0; i < fn.blocks.size(); ++i) {
+            BasicBlock* block = fn.blocks[i];
+            while (block->term == BasicBlock::Jump) {
+                BasicBlock* next = block->succs[0];
+                if (next->preds.size() != 1 || next == fn.blocks[0]) { break; }
+                for (Instr* instr : next->instrs) {
+                    if (instr->op == Phi) {
+                        instr->forward = resolve(instr->args[0]);
+                        continue;
+                    }
+                    instr->block = block;
+                    block->instrs.push_back(instr);
+                }
+                block->term = next->term;
+                block->value = next->value;
+                block->succs = next->succs;
+                for (BasicBlock* succ : next->succs) {
+                    for (BasicBlock*& pred : succ->preds) {
+                        if (pred == next) { pred = block; }
+                    }
+                }
+                fn.delete_block(next);
+                changed = true;
+            }
+        }
+        return changed;
+    }
+
+    /* Dominator tree, by the iterative algorithm of Cooper, Harvey
+     * and Kennedy.  Blocks are in reverse postorder, so a block's
+     * index is a fine stand-in for its reverse postorder number.
+     */
+    static std::vector<int> dominators(Function& fn) {
+        std::map<BasicBlock*, int> index;
+        for (size_t i = 0; i < fn.blocks.size(); ++i) { index[fn.blocks[i]] = static_cast<int>(i); }
+        std::vector<int> idom(fn.blocks.size(), -1);
+        idom[0] = 0;
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (size_t b = 1; b < fn.blocks.size(); ++b) {
+                int new_idom = -1;
+                for (BasicBlock* pred : fn.blocks[b]->preds) {
+                    int p = index[pred];
+                    if (idom[p] == -1) { continue; }
+                    if (new_idom == -1) { new_idom = p; continue; }
+                    int a = p, c = new_idom;
+                    while (a != c) {
+                        while (a > c) { a = idom[a]; }
+                        while (c > a) { c = idom[c]; }
+                    }
+                    new_idom = a;
+                }
+                if (idom[b] != new_idom) {
+                    idom[b] = new_idom;
+                    changed = true;
+                }
+            }
+        }
+        return idom;
+    }
+
+    /* Global value numbering:  Walk the dominator tree, remembering
+     * every computation seen on the way down.  A computation that has
+     * already been done in a dominating block (or earlier in this one)
+     * is replaced by the earlier value.
+     */
+    typedef std::tuple<int, int, int, std::vector<int>> ValueKey;  // op, imm, block (phis), args
+
+    static ValueKey key_of(Instr* instr) {
+        std::vector<int> args;
+        for (Instr* arg : instr->args) { args.push_back(resolve(arg)->id); }
+        if ((instr->op == Add || instr->op == Mul || instr->op == Equals) && args[0] > args[1]) {
+            std::swap(args[0], args[1]);   // Commutative
+        }
+        int block = instr->op == Phi ? instr->block->id : -1;
+        return std::make_tuple(static_cast<int>(instr->op), instr->imm, block, args);
+    }
+
+    static bool number_values(Function& fn, std::vector<std::vector<int>>& children, int b,
+                              std::map<ValueKey, Instr*>& available) {
+        bool changed = false;
+        std::vector<ValueKey> added;
+        BasicBlock* block = fn.blocks[b];
+        std::vector<Instr*> kept;
+        for (Instr* instr : block->instrs) {
+            ValueKey key = key_of(instr);
+            auto found = available.find(key);
+            if (found != available.end()) {
+                instr->forward = found->second;
+                changed = true;
+                continue;
+            }
+            available[key] = instr;
+            added.push_back(key);
+            kept.push_back(instr);
+        }
+        block->instrs = kept;
+        for (int child : children[b]) {
+            changed |= number_values(fn, children, child, available);
+        }
+        for (auto& key : added) { available.erase(key); }
+        return changed;
+    }
+
+    static bool gvn(Function& fn) {
+        std::vector<int> idom = dominators(fn);
+        std::vector<std::vector<int>> children(fn.blocks.size());
+        for (size_t b = 1; b < fn.blocks.size(); ++b) { children[idom[b]].push_back(static_cast<int>(b)); }
+        std::map<ValueKey, Instr*> available;
+        return number_values(fn, children, 0, available);
+    }
+
+    /* Could this instruction trap at run time?  Only a division can,
+     * by zero or INT_MIN / -1, and only fold() can tell it won't.
+     */
+    static bool may_trap(Instr* instr) {
+        if (instr->op != Div) { return false; }
+        Instr* left = resolve(instr->args[0]);
+        Instr* right = resolve(instr->args[1]);
+        if (right->op != Const || right->imm == 0) { return true; }
+        return right->imm == -1 && (left->op != Const || left->imm == INT_MIN);
+    }
+
+    /* The only side effect is a trap, so anything that doesn't
+     * contribute to a branch or the result, and can't trap, can go.
+     * A division that might trap stays, with everything it uses.
+     */
+    static bool remove_dead(Function& fn) {
+        std::set<Instr*> live;
+        std::vector<Instr*> work;
+        for (BasicBlock* block : fn.blocks) {
+            if (block->value != nullptr) { work.push_back(resolve(block->value)); }
+            for (Instr* instr : block->instrs) {
+                if (may_trap(instr)) { work.push_back(instr); }
+            }
+        }
+        while (! work.empty()) {
+            Instr* instr = work.back();
+            work.pop_back();
+            if (! live.insert(instr).second) { continue; }
+            for (Instr* arg : instr->args) { work.push_back(resolve(arg)); }
+        }
+        bool changed = false;
+        for (BasicBlock* block : fn.blocks) {
+            std::vector<Instr*> kept;
+            for (Instr* instr : block->instrs) {
+                if (live.count(instr)) { kept.push_back(instr); } else { changed = true; }
+            }
+            block->instrs = kept;
+        }
+        return changed;
+    }
+
+    void optimize(Function& fn) {
+        fn.layout();
+        bool changed = true;
+        while (changed) {
+            changed = propagate(fn);
+            changed |= fold_branches(fn);
+            changed |= merge_blocks(fn);
+            changed |= gvn(fn);
+            changed |= remove_dead(fn);
+        }
+        // Leave no forwarded values behind for the backends
+        propagate(fn);
+    }
+
+}
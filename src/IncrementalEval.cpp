@@ -0,0 +1,123 @@
+//
+// Incremental re-evaluation; see IncrementalEval.h
+//
+
+#include "IncrementalEval.h"
+#include <algorithm>
+#include <functional>
+
+namespace AST {
+
+    /* Dependence analysis is done once, up front */
+    IncrementalEval::IncrementalEval(Block& program) : users_(1), result_{0} {
+        for (ASTNode* node : program.stmts()) {
+            int index = static_cast<int>(stmts_.size());
+            VarUse use;
+            node->uses(use);
+            Stmt stmt;
+            stmt.node = node;
+            stmt.value = 0;
+            stmt.writes.assign(use.writes.begin(), use.writes.end());
+            std::set<std::string> reads = use.reads;
+            reads.insert(use.writes.begin(), use.writes.end());
+            for (const std::string& var : reads) {
+                auto def = last_def_.find(var);
+                int from = (def == last_def_.end()) ? input : def->second;
+                stmt.reads.push_back(var);
+                stmt.reaching.push_back(from);
+                users_[from + 1][var].push_back(index);
+            }
+            for (const std::string& var : stmt.writes) {
+                last_def_[var] = index;
+            }
+            stmts_.push_back(stmt);
+            users_.emplace_back();
+        }
+        queued_.assign(stmts_.size(), false);
+    }
+
+    /* Value of var as defined by statement 'def' (or the input).
+     * False if it is unassigned, which Ident::eval treats as zero
+     * but which is not the same thing in the final symbol table.
+     */
+    bool IncrementalEval::lookup(int def, const std::string& var, int& value) {
+        const Bindings& from = (def == input) ? inputs_ : stmts_[def].out;
+        auto found = from.find(var);
+        if (found == from.end()) { return false; }
+        value = found->second;
+        return true;
+    }
+
+    int IncrementalEval::eval(EvalContext& ctx) {
+        inputs_ = ctx.symtab;
+        int result = 0;
+        for (Stmt& stmt : stmts_) {
+            result = stmt.value = stmt.node->eval(ctx);
+            stmt.out.clear();
+            for (const std::string& var : stmt.writes) {
+                auto found = ctx.symtab.find(var);
+                if (found != ctx.symtab.end()) { stmt.out[var] = found->second; }
+            }
+        }
+        result_ = result;
+        return result;
+    }
+
+    void IncrementalEval::queue(int i) {
+        if (queued_[i]) { return; }
+        queued_[i] = true;
+        pending_.push_back(i);
+        std::push_heap(pending_.begin(), pending_.end(), std::greater<int>());
+    }
+
+    /* Re-execute statement i against the remembered values of what it
+     * reads, and queue the statements that see any output that changed.
+     */
+    void IncrementalEval::run(int i, EvalContext& ctx) {
+        Stmt& stmt = stmts_[i];
+        EvalContext local;
+        for (size_t r = 0; r < stmt.reads.size(); ++r) {
+            int value;
+            if (lookup(stmt.reaching[r], stmt.reads[r], value)) {
+                local.symtab[stmt.reads[r]] = value;
+            }
+        }
+        stmt.value = stmt.node->eval(local);
+        if (i + 1 == static_cast<int>(stmts_.size())) { result_ = stmt.value; }
+        for (const std::string& var : stmt.writes) {
+            auto now = local.symtab.find(var);
+            auto before = stmt.out.find(var);
+            bool had = before != stmt.out.end();
+            bool has = now != local.symtab.end();
+            if (had == has && (! has || before->second == now->second)) { continue; }
+            if (has) { stmt.out[var] = now->second; } else { stmt.out.erase(var); }
+            if (last_def_[var] == i) {
+                if (has) { ctx.symtab[var] = now->second; } else { ctx.symtab.erase(var); }
+            }
+            for (int user : users_[i + 1][var]) { queue(user); }
+        }
+    }
+
+    int IncrementalEval::update(const Bindings& changed, EvalContext& ctx) {
+        for (const auto& binding : changed) {
+            auto old = inputs_.find(binding.first);
+            if (old != inputs_.end() && old->second == binding.second) { continue; }
+            inputs_[binding.first] = binding.second;
+            if (last_def_.count(binding.first) == 0) {
+                ctx.symtab[binding.first] = binding.second;
+            }
+            for (int user : users_[0][binding.first]) { queue(user); }
+        }
+        // Users always come after what they use, so a statement that
+        // has run can't be queued again in this update
+        while (! pending_.empty()) {
+            std::pop_heap(pending_.begin(), pending_.end(), std::greater<int>());
+            int i = pending_.back();
+            pending_.pop_back();
+            queued_[i] = false;
+            run(i, ctx);
+        }
+        return result_;
+    }
+
+}
@@ -0,0 +1,78 @@
+//
+// Incremental re-evaluation, spreadsheet style.
+//
+// We evaluate a program once, remembering what each top-level
+// statement read and wrote.  When a few input variables change,
+// we re-execute only the statements that (transitively) depend on
+// them and reuse the remembered values for everything else.  The
+// results are the same as evaluating the whole Block again.
+//
+// A statement reads its variables as they were just before it, so
+// for each variable a statement reads we record which earlier
+// statement (or the program input) last might have assigned it.
+// Those def-use edges are what we follow when something changes.
+// An 'if' that might assign x also counts as reading x, since if
+// it takes the other arm, x passes through unchanged.
+//
+
+#ifndef AST_INCREMENTALEVAL_H
+#define AST_INCREMENTALEVAL_H
+
+#include "ASTNode.h"
+#include "EvalContext.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace AST {
+
+    class IncrementalEval {
+        typedef std::unordered_map<std::string, int> Bindings;
+        static const int input = -1;  // "Defined" by the program input
+
+        /* What we remember about each top-level statement */
+        struct Stmt {
+            ASTNode* node;
+            std::vector<std::string> reads;   // Including pass-through of conditional writes
+            std::vector<int> reaching;        // Where each read gets its value (index or input)
+            std::vector<std::string> writes;
+            Bindings out;                     // Values of 'writes' after the statement, if assigned
+            int value;                        // Value of the statement itself
+        };
+        std::vector<Stmt> stmts_;
+        // Def-use edges: users_[d+1][x] are the statements that read x as defined by d
+        std::vector<std::unordered_map<std::string, std::vector<int>>> users_;
+        // Which statement provides the final value of each variable
+        std::unordered_map<std::string, int> last_def_;
+        Bindings inputs_;
+        int result_;
+
+        // Statements to re-execute, a min-heap so they run in program
+        // order, and which are in it.  Kept between updates so that an
+        // update costs nothing for the statements it doesn't touch;
+        // each entry of queued_ is cleared again when its statement runs.
+        std::vector<int> pending_;
+        std::vector<bool> queued_;
+
+        bool lookup(int def, const std::string& var, int& value);
+        void queue(int i);
+        void run(int i, EvalContext& ctx);
+    public:
+        explicit IncrementalEval(Block& program);
+
+        /* Full evaluation.  On entry ctx holds the inputs, and on
+         * return it holds the same results as program.eval(ctx).
+         */
+        int eval(EvalContext& ctx);
+
+        /* Change some inputs and bring ctx (the context from the last
+         * eval or update) up to date.  Only the entries that change are
+         * touched, and the time taken depends on the statements that
+         * are re-executed, not on the size of the program.
+         */
+        int update(const Bindings& changed, EvalContext& ctx);
+    };
+
+}
+
+#endif //AST_INCREMENTALEVAL_H
@@ -4,16 +4,22 @@
 
 #include "Messages.h"
 #include "location.hh"
+#include "Governor.h"
+#include <atomic>
 
 namespace report {
 
-/* The error count is global */
-static int error_count = 0;           // How many errors so far? */
+/* The error count is global.  It is atomic because with a
+ * pipelined scanner (-t), the scanner thread and the parser thread
+ * can both report errors.
+ */
+static std::atomic<int> error_count{0};  // How many errors so far? */
 const int  error_limit = 5;           // Should be configurable
 
 void bail()
 {
-    std::cerr << "Too many errors, bailing" << std::endl;;
+    std::cerr << "Too many errors, bailing" << std::endl;
+    throw governor::LimitExceeded("errors", error_limit);
 }
 
 /* An error that we can locate in the input */
@@ -48,4 +54,9 @@ bool ok() {
     return (error_count == 0);
 }
 
+/* Start over with a clean slate */
+void reset() {
+    error_count = 0;
+}
+
 };
\ No newline at end of file
@@ -21,7 +21,8 @@
 
 namespace report {
 
-    // Halt execution if there are too many errors
+    // Halt execution if there are too many errors, by throwing
+    // governor::LimitExceeded (so that a server can go on to the next request)
     void bail();
 
     /* An error that we can locate in the input */
@@ -36,6 +37,9 @@ namespace report {
     /* Is everything ok, or have we encountered errors? */
     bool ok();
 
+    /* Forget errors reported so far, e.g., before the next request in server mode */
+    void reset();
+
 };
 
 
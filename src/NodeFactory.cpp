@@ -0,0 +1,37 @@
+//
+// Hash-consing; see NodeFactory.h
+//
+
+#include "NodeFactory.h"
+
+namespace AST {
+
+    thread_local NodeFactory* NodeFactory::current_ = nullptr;
+
+    Ident* NodeFactory::ident(const std::string& name) {
+        if (! current_) { return new Ident(name); }
+        auto found = current_->idents_.find(name);
+        if (found != current_->idents_.end()) {
+            ++current_->shared_;
+            return found->second;
+        }
+        Ident* node = new Ident(name);
+        current_->idents_.emplace(name, node);
+        ++current_->built_;
+        return node;
+    }
+
+    IntConst* NodeFactory::constant(int value) {
+        if (! current_) { return new IntConst(value); }
+        auto found = current_->constants_.find(value);
+        if (found != current_->constants_.end()) {
+            ++current_->shared_;
+            return found->second;
+        }
+        IntConst* node = new IntConst(value);
+        current_->constants_.emplace(value, node);
+        ++current_->built_;
+        return node;
+    }
+
+}
@@ -0,0 +1,98 @@
+//
+// Hash-consing (parser -H):  The parser builds leaves and arithmetic
+// through the factory, which returns the node it already built for an
+// identical subtree instead of building another.  Machine-generated
+// programs repeat the same identifiers, constants and subexpressions
+// over and over, and they all become one node each.
+//
+// Only pure subtrees are shared:  identifiers, constants and the
+// arithmetic operators, which can't contain an assignment or an 'if'.
+// Their children have already been through the factory, so two
+// subtrees are identical exactly when they are the same operator on
+// the same child nodes, and we never have to compare whole trees.
+//
+// The AST becomes a DAG.  Nothing in a node depends on where it
+// appears, so evaluation and code generation simply visit a shared
+// node once for each place it is used, and json prints it in each
+// place, as if the tree weren't shared.  A profile (parser -p) counts
+// the evaluations of a shared node from all its places together.
+//
+// With no factory in use, the factory functions just build new nodes.
+//
+
+#ifndef AST_NODEFACTORY_H
+#define AST_NODEFACTORY_H
+
+#include "ASTNode.h"
+#include <functional>
+#include <string>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
+
+namespace AST {
+
+    class NodeFactory {
+        // An operator applied to particular (already shared) children
+        struct Key {
+            std::type_index op;
+            ASTNode* left;
+            ASTNode* right;
+            bool operator==(const Key& other) const {
+                return op == other.op && left == other.left && right == other.right;
+            }
+        };
+        struct KeyHash {
+            size_t operator()(const Key& key) const {
+                size_t h = key.op.hash_code();
+                h = h * 31 + std::hash<ASTNode*>()(key.left);
+                return h * 31 + std::hash<ASTNode*>()(key.right);
+            }
+        };
+        std::unordered_map<std::string, Ident*> idents_;
+        std::unordered_map<int, IntConst*> constants_;
+        std::unordered_map<Key, ASTNode*, KeyHash> operators_;
+        long built_;    // Nodes built
+        long shared_;   // Requests answered with a node already built
+        static thread_local NodeFactory* current_;
+
+    public:
+        NodeFactory() : built_{0}, shared_{0} {}
+        NodeFactory(const NodeFactory&) = delete;
+        NodeFactory& operator=(const NodeFactory&) = delete;
+        long built() const { return built_; }
+        long shared() const { return shared_; }
+
+        /* Nodes built while a Use is in scope are shared through the
+         * factory.  The nodes are still owned by the current NodeArena
+         * (if any); the factory must not outlive them.
+         */
+        class Use {
+            NodeFactory* saved_;
+        public:
+            explicit Use(NodeFactory& factory) : saved_{current_} { current_ = &factory; }
+            ~Use() { current_ = saved_; }
+        };
+
+        static Ident* ident(const std::string& name);
+        static IntConst* constant(int value);
+
+        template <class Op>
+        static ASTNode* binop(ASTNode& left, ASTNode& right) {
+            if (! current_) { return new Op(left, right); }
+            Key key{std::type_index(typeid(Op)), &left, &right};
+            auto found = current_->operators_.find(key);
+            if (found != current_->operators_.end()) {
+                ++current_->shared_;
+                return found->second;
+            }
+            ASTNode* node = new Op(left, right);
+            current_->operators_.emplace(key, node);
+            ++current_->built_;
+            return node;
+        }
+    };
+
+}
+
+#endif //AST_NODEFACTORY_H
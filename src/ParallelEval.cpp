@@ -0,0 +1,179 @@
+//
+// Parallel evaluation over a dependence DAG; see ParallelEval.h
+//
+
+#include "ParallelEval.h"
+#include <atomic>
+#include <exception>
+#include <memory>
+
+namespace AST {
+
+    ParallelEval::ParallelEval(int workers) : pool_(workers) { }
+
+    ParallelEval::~ParallelEval() {
+        for (auto& p : plans_) { delete p.second; }
+    }
+
+    /* New slots are only made for the plan of the whole program, which
+     * is built before any task runs.  The blocks inside it use no
+     * variable the whole program doesn't, so their plans only look.
+     */
+    ParallelEval::SlotList ParallelEval::slot_list(const std::set<std::string>& vars) {
+        SlotList list;
+        for (const std::string& var : vars) {
+            auto found = slots_.find(var);
+            if (found == slots_.end()) { found = slots_.emplace(var, Slot{0, false}).first; }
+            list.push_back(std::make_pair(var, &found->second));
+        }
+        return list;
+    }
+
+    /* About how many nodes of statements make a task worth starting */
+    static const size_t grain = 1000;
+
+    static size_t nodes(ASTNode* stmt) {
+        std::vector<ASTNode*> pending{stmt};
+        size_t n = 0;
+        while (! pending.empty()) {
+            ASTNode* node = pending.back();
+            pending.pop_back();
+            ++n;
+            node->children(pending);
+        }
+        return n;
+    }
+
+    /* Build (once) the dependence DAG for a block.  Task i must wait
+     * for an earlier task j if j writes something i reads or writes,
+     * or j reads something i writes.
+     */
+    ParallelEval::Plan& ParallelEval::plan(Block& block) {
+        std::lock_guard<std::mutex> guard(plans_lock_);
+        Plan*& plan = plans_[&block];
+        if (plan != nullptr) { return *plan; }
+        plan = new Plan();
+        std::vector<VarUse> uses;
+        size_t cost = grain;     // Of the last task so far
+        for (ASTNode* stmt : block.stmts()) {
+            // A big statement is a task by itself, so that if it is an
+            // if, its arm can be run in parallel too
+            size_t size = nodes(stmt);
+            bool alone = size >= grain;
+            if (alone || cost >= grain) {
+                plan->tasks.emplace_back();
+                uses.emplace_back();
+                cost = 0;
+            }
+            plan->tasks.back().stmts.push_back(stmt);
+            stmt->uses(uses.back());
+            cost = alone ? grain : cost + size;
+        }
+        size_t n = plan->tasks.size();
+        plan->succs.resize(n);
+        plan->npreds.resize(n);
+        std::unordered_map<std::string, int> last_writer;
+        std::unordered_map<std::string, std::vector<int>> readers_since;
+        for (size_t i = 0; i < n; ++i) {
+            VarUse& use = uses[i];
+            std::set<std::string> vars = use.reads;
+            vars.insert(use.writes.begin(), use.writes.end());
+            plan->tasks[i].vars = slot_list(vars);
+            plan->tasks[i].writes = slot_list(use.writes);
+
+            std::set<int> preds;
+            for (const std::string& var : vars) {
+                auto w = last_writer.find(var);
+                if (w != last_writer.end()) { preds.insert(w->second); }
+            }
+            for (const std::string& var : use.writes) {
+                std::vector<int>& readers = readers_since[var];
+                preds.insert(readers.begin(), readers.end());
+                readers.clear();
+                last_writer[var] = static_cast<int>(i);
+            }
+            for (const std::string& var : use.reads) {
+                if (use.writes.count(var) == 0) {
+                    readers_since[var].push_back(static_cast<int>(i));
+                }
+            }
+            for (int p : preds) { plan->succs[p].push_back(static_cast<int>(i)); }
+            plan->npreds[i] = static_cast<int>(preds.size());
+        }
+        return *plan;
+    }
+
+    int ParallelEval::eval_task(Plan& plan, int i) {
+        Task& task = plan.tasks[i];
+        EvalContext local;
+        for (auto& var : task.vars) {
+            if (var.second->present) { local.symtab[var.first] = var.second->value; }
+        }
+        if (task.stmts.size() == 1) {
+            Block* arm = task.stmts[0]->select(local);
+            if (arm != nullptr) { return eval_block(*arm); }
+        }
+        int value = 0;
+        for (ASTNode* stmt : task.stmts) { value = stmt->eval(local); }
+        for (auto& var : task.writes) {
+            auto found = local.symtab.find(var.first);
+            if (found != local.symtab.end()) {
+                var.second->value = found->second;
+                var.second->present = true;
+            }
+        }
+        return value;
+    }
+
+    /* Start every task whose predecessors are done, and help out
+     * in the pool until the whole block has finished.
+     */
+    int ParallelEval::eval_block(Block& block) {
+        Plan& p = plan(block);
+        int n = static_cast<int>(p.tasks.size());
+        if (n == 0) { return 0; }
+        if (n == 1) { return eval_task(p, 0); }
+        std::vector<int> values(n);
+        std::unique_ptr<std::atomic<int>[]> waiting(new std::atomic<int>[n]);
+        for (int i = 0; i < n; ++i) { waiting[i].store(p.npreds[i]); }
+        std::atomic<int> done{0};
+        // The first exception from a task (e.g., over a time limit),
+        // to throw again from here once everything has finished
+        std::exception_ptr failure;
+        std::mutex failure_lock;
+        std::function<void(int)> start = [&](int i) {
+            pool_.submit([&, i] {
+                try {
+                    values[i] = eval_task(p, i);
+                } catch (...) {
+                    std::lock_guard<std::mutex> guard(failure_lock);
+                    if (! failure) { failure = std::current_exception(); }
+                }
+                for (int s : p.succs[i]) {
+                    if (waiting[s].fetch_sub(1, std::memory_order_acq_rel) == 1) { start(s); }
+                }
+                done.fetch_add(1, std::memory_order_release);
+            });
+        };
+        for (int i = 0; i < n; ++i) {
+            if (p.npreds[i] == 0) { start(i); }
+        }
+        pool_.help_while([&] { return done.load(std::memory_order_acquire) < n; });
+        if (failure) { std::rethrow_exception(failure); }
+        return values[n - 1];
+    }
+
+    int ParallelEval::eval(ASTNode& program, EvalContext& ctx) {
+        Block* block = dynamic_cast<Block*>(&program);
+        if (block == nullptr) { return program.eval(ctx); }
+        for (auto& slot : slots_) { slot.second = Slot{0, false}; }
+        for (auto& binding : ctx.symtab) { slots_[binding.first] = Slot{binding.second, true}; }
+        plan(*block);   // The first time, this makes the program's slots
+        int result = eval_block(*block);
+        for (auto& slot : slots_) {
+            if (slot.second.present) { ctx.symtab[slot.first] = slot.second.value; }
+        }
+        return result;
+    }
+
+}
@@ -0,0 +1,77 @@
+//
+// Parallel evaluation of the statements of a Block.
+//
+// Two statements can run at the same time if neither writes a
+// variable the other reads or writes.  Most statements are a few
+// nodes, far less work than handing them to another thread, so the
+// statements of a block are first cut into tasks:  runs of consecutive
+// statements of about 'grain' nodes, done in order by one worker.  A
+// statement bigger than that (say, an 'if' with a lot in its arms) is
+// a task by itself.  For each block we build a
+// dependence graph of its tasks (a DAG, since edges always point
+// forward in the program) and run each task on a work-stealing pool
+// as soon as the tasks it depends on are done.  When an 'if' runs, it
+// picks its arm and the arm is evaluated the same way.
+//
+// Variables live in slots that are all created before evaluation
+// starts, so the table of slots is never modified while tasks run,
+// and the dependence graph guarantees that no two tasks touching the
+// same slot overlap.  A task runs against a private EvalContext
+// loaded from the slots it uses, and stores back what it assigned.
+//
+
+#ifndef AST_PARALLELEVAL_H
+#define AST_PARALLELEVAL_H
+
+#include "ASTNode.h"
+#include "EvalContext.h"
+#include "WorkPool.h"
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace AST {
+
+    class ParallelEval {
+        struct Slot {
+            int value;
+            bool present;   // Unassigned is not quite the same as zero
+        };
+        typedef std::vector<std::pair<std::string, Slot*>> SlotList;
+
+        /* Statements run in order by one worker */
+        struct Task {
+            std::vector<ASTNode*> stmts;
+            SlotList vars;                   // Everything they might read or write
+            SlotList writes;
+        };
+
+        /* The dependence DAG of the tasks of one block */
+        struct Plan {
+            std::vector<Task> tasks;
+            std::vector<std::vector<int>> succs;
+            std::vector<int> npreds;
+        };
+
+        WorkPool pool_;
+        std::unordered_map<std::string, Slot> slots_;
+        std::mutex plans_lock_;
+        std::unordered_map<Block*, Plan*> plans_;
+
+        Plan& plan(Block& block);
+        SlotList slot_list(const std::set<std::string>& vars);
+        int eval_block(Block& block);
+        int eval_task(Plan& plan, int i);
+    public:
+        explicit ParallelEval(int workers);
+        ~ParallelEval();
+
+        /* Same result and same final ctx as program.eval(ctx) */
+        int eval(ASTNode& program, EvalContext& ctx);
+    };
+
+}
+
+#endif //AST_PARALLELEVAL_H
@@ -0,0 +1,127 @@
+//
+// Partial evaluation; see PartialEval.h
+//
+
+#include "PartialEval.h"
+
+namespace AST {
+
+    PartialEval::PartialEval(const std::map<std::string, int>& known) :
+            out_{nullptr}, need_value_{false}, value_known_{true}, value_{0} {
+        for (auto& binding : known) {
+            store_[binding.first] = Binding{true, binding.second, false};
+        }
+    }
+
+    Block* PartialEval::residual(Block& program) {
+        return specialize_block(program, true);
+    }
+
+    bool PartialEval::known(const std::string& var, int& value) const {
+        auto found = store_.find(var);
+        if (found == store_.end() || ! found->second.known) { return false; }
+        value = found->second.value;
+        return true;
+    }
+
+    /* Only the last statement of a block can give the block its value.
+     * If we know that value but no residual statement produces it,
+     * the block ends with it as a constant.
+     */
+    Block* PartialEval::specialize_block(Block& block, bool need_value) {
+        Block* saved_out = out_;
+        bool saved_need = need_value_;
+        out_ = new Block();
+        need_value_ = need_value;
+        splice(block);
+        if (need_value && value_known_) {
+            out_->append(new IntConst(value_));
+        }
+        Block* result = out_;
+        out_ = saved_out;
+        need_value_ = saved_need;
+        return result;
+    }
+
+    void PartialEval::splice(Block& arm) {
+        bool need = need_value_;
+        const std::vector<ASTNode*>& stmts = arm.stmts();
+        value_known_ = true;  // The value of an empty block is 0
+        value_ = 0;
+        for (size_t i = 0; i < stmts.size(); ++i) {
+            need_value_ = need && i + 1 == stmts.size();
+            stmts[i]->specialize(*this);
+        }
+        need_value_ = need;
+    }
+
+    /* The only side effect an expression can have is a trap, so one
+     * whose value isn't used can go unless it might divide by zero.
+     * BinOp::residual_of leaves any division that would trap unfolded.
+     */
+    void PartialEval::emit(ASTNode* stmt) {
+        if (IntConst* constant = dynamic_cast<IntConst*>(stmt)) {
+            value_known_ = true;
+            value_ = constant->value();
+            return;
+        }
+        if (! need_value_ && dynamic_cast<Assign*>(stmt) == nullptr
+                && dynamic_cast<If*>(stmt) == nullptr && dynamic_cast<Switch*>(stmt) == nullptr
+                && ! may_trap(stmt)) {
+            return;
+        }
+        out_->append(stmt);
+        value_known_ = false;
+    }
+
+    void PartialEval::assign(Ident& var, ASTNode* value) {
+        IntConst* constant = dynamic_cast<IntConst*>(value);
+        if (constant != nullptr && must_store_.count(var.name()) == 0) {
+            store_[var.name()] = Binding{true, constant->value(), false};
+            value_known_ = true;
+            value_ = constant->value();
+            return;
+        }
+        store_[var.name()] = Binding{constant != nullptr, constant ? constant->value() : 0, true};
+        out_->append(new Assign(var, *value));
+        value_known_ = false;
+    }
+
+    /* After the branch, a variable the arms may assign is known only
+     * if both (all) arms leave it with the same known value.
+     */
+    std::vector<Block*> PartialEval::arms(const std::vector<Block*>& arms) {
+        VarUse use;
+        for (Block* arm : arms) { arm->uses(use); }
+        for (const std::string& var : use.writes) {
+            auto found = store_.find(var);
+            if (found != store_.end() && ! found->second.stored) {
+                out_->append(new Assign(*new Ident(var), *new IntConst(found->second.value)));
+                found->second.stored = true;
+            }
+        }
+        std::map<std::string, Binding> before = store_;
+        std::set<std::string> saved_must_store = must_store_;
+        must_store_.insert(use.writes.begin(), use.writes.end());
+        std::vector<Block*> residuals;
+        std::map<std::string, Binding> joined;
+        for (size_t i = 0; i < arms.size(); ++i) {
+            store_ = before;
+            residuals.push_back(specialize_block(*arms[i], need_value_));
+            for (const std::string& var : use.writes) {
+                auto found = store_.find(var);
+                Binding after = found == store_.end() ? Binding{false, 0, true} : found->second;
+                if (i == 0) {
+                    joined[var] = after;
+                } else if (! (after.known && joined[var].known && after.value == joined[var].value)) {
+                    joined[var].known = false;
+                }
+            }
+        }
+        store_ = before;
+        for (auto& binding : joined) { store_[binding.first] = binding.second; }
+        must_store_ = saved_must_store;
+        return residuals;
+    }
+
+}
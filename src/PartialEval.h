@@ -0,0 +1,82 @@
+//
+// Partial evaluation (parser -D name=value):  Specialize a program
+// for variables whose starting values we already know.
+//
+// We walk the program as eval would, but with a store that knows the
+// values of only some of the variables.  An expression whose operands
+// are all known becomes a constant; an assignment of a constant just
+// updates the store; an 'if' whose condition becomes known is replaced
+// by the arm it would take.  Everything else is copied into a residual
+// program, with the known values substituted.  The residual program
+// computes the same value as the original would with the known
+// variables set, by doing only the work that depends on the rest.
+//
+// The residual program does not assign variables whose values were
+// known, except where it must:  Where an 'if' we can't decide might
+// assign a variable, that variable has to hold its real value when the
+// arms join, so we store its known value before the 'if', and the
+// arms assign it as the original did.
+//
+
+#ifndef AST_PARTIALEVAL_H
+#define AST_PARTIALEVAL_H
+
+#include "ASTNode.h"
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace AST {
+
+    class PartialEval {
+        struct Binding {
+            bool known;      // Do we know the value?
+            int value;
+            bool stored;     // Does the residual program's variable hold it?
+        };
+        // A variable not in the store is an input:  unknown, but stored.
+        std::map<std::string, Binding> store_;
+        // Variables the enclosing undecided branches may assign;
+        // assignments to them must stay in the residual program.
+        std::set<std::string> must_store_;
+
+        Block* out_;          // Residual statements go here
+        bool need_value_;     // Is the value of the current statement used?
+        bool value_known_;    // Value of the last statement, if known;
+        int value_;           // otherwise it's the last residual statement's value
+
+        Block* specialize_block(Block& block, bool need_value);
+
+    public:
+        explicit PartialEval(const std::map<std::string, int>& known);
+
+        /* The residual of a whole program */
+        Block* residual(Block& program);
+
+        /* For the AST's residual and specialize methods: */
+
+        /* Is the variable's value known?  What is it? */
+        bool known(const std::string& var, int& value) const;
+
+        /* A residual statement.  If it is a constant, nothing is
+         * emitted; we just remember its value.
+         */
+        void emit(ASTNode* stmt);
+
+        /* var = value, where value is already a residual expression */
+        void assign(Ident& var, ASTNode* value);
+
+        /* The statements of an arm we have chosen, in place of the branch */
+        void splice(Block& arm);
+
+        /* The residual arms of a branch we can't decide.  Emits stores
+         * of known values that the arms may change, first.  The caller
+         * then emits the branch itself.
+         */
+        std::vector<Block*> arms(const std::vector<Block*>& arms);
+    };
+
+}
+
+#endif //AST_PARTIALEVAL_H
@@ -0,0 +1,87 @@
+//
+// Scanner thread feeding the parser through a TokenRing.
+//
+
+#include "PipelinedSource.h"
+#include <cstdlib>
+
+namespace yy {
+
+    /* How many times to spin on an empty or full ring before
+     * giving the core away.  Spinning a little is much cheaper
+     * than a trip through the scheduler when the other side is
+     * just about to catch up.
+     */
+    static const int spin_limit = 64;
+
+    PipelinedSource::PipelinedSource(const reflex::Input in) :
+            lexer_(in), stopping_{false}, finished_{false} {
+        scanner_ = std::thread(&PipelinedSource::scan, this);
+    }
+
+    /* The parser may quit before it has seen the end of input
+     * (e.g., on an error it can't recover from), so we may have
+     * to tell the scanner thread to stop waiting for room in the ring.
+     * Identifiers it never got are still strdup'ed; free them.
+     */
+    PipelinedSource::~PipelinedSource() {
+        stopping_.store(true, std::memory_order_release);
+        scanner_.join();
+        Token tok;
+        while (ring_.pop(tok)) { discard(tok); }
+    }
+
+    void PipelinedSource::discard(Token& tok) {
+        if (tok.kind == parser::token::IDENT) { free(tok.value.str); }
+    }
+
+    /* Producer side: Push a token, waiting for room if necessary.
+     * False if the parser has gone away.
+     */
+    bool PipelinedSource::deliver(const Token& tok) {
+        int spins = 0;
+        while (! ring_.push(tok)) {
+            if (stopping_.load(std::memory_order_acquire)) { return false; }
+            if (++spins > spin_limit) { std::this_thread::yield(); }
+        }
+        return true;
+    }
+
+    void PipelinedSource::scan() {
+        Token tok;
+        try {
+            do {
+                governor::charge_token();
+                tok.kind = lexer_.yylex(&tok.value, &tok.loc);
+                if (! deliver(tok)) {
+                    discard(tok);
+                    return;
+                }
+            } while (tok.kind != 0);  // 0 is end of input
+        } catch (...) {
+            // Let the parser thread see the exception as if
+            // it had been thrown by its own call to yylex.
+            scanner_error_ = std::current_exception();
+            tok.kind = scanner_failed;
+            deliver(tok);
+        }
+    }
+
+    /* Consumer side: Called by the parser in place of lexer.yylex */
+    int PipelinedSource::yylex(parser::semantic_type* yylval, location* yylloc) {
+        if (finished_) { return 0; }  // Nothing more will arrive
+        Token tok;
+        int spins = 0;
+        while (! ring_.pop(tok)) {
+            if (++spins > spin_limit) { std::this_thread::yield(); }
+        }
+        if (tok.kind == scanner_failed) {
+            std::rethrow_exception(scanner_error_);
+        }
+        *yylval = tok.value;
+        *yylloc = tok.loc;
+        finished_ = (tok.kind == 0);
+        return tok.kind;
+    }
+
+}
@@ -0,0 +1,50 @@
+//
+// A TokenSource that runs the reflex scanner in its own thread,
+// so that scanning of the input overlaps parsing.  Tokens (with
+// their semantic values and locations) are passed to the parser
+// through a lock-free single-producer, single-consumer ring.
+//
+// This only pays off for big inputs on a machine with a spare core;
+// for a few hundred bytes, starting the thread costs more than the
+// whole parse.
+//
+
+#ifndef AST_PIPELINEDSOURCE_H
+#define AST_PIPELINEDSOURCE_H
+
+#include "TokenSource.h"
+#include "TokenRing.h"
+#include <atomic>
+#include <exception>
+#include <thread>
+
+namespace yy {
+
+    class PipelinedSource : public TokenSource {
+        /* What the scanner thread produces for each call to yylex */
+        struct Token {
+            int kind;
+            parser::semantic_type value;
+            location loc;
+        };
+        static const int scanner_failed = -1;  // Token kind; rethrow scanner_error_
+
+        Lexer lexer_;
+        TokenRing<Token, 4096> ring_;
+        std::atomic<bool> stopping_;        // Parser is done, even if scanner isn't
+        std::exception_ptr scanner_error_;  // Written before scanner_failed is pushed
+        bool finished_;                     // Parser has already seen end of input
+        std::thread scanner_;
+
+        void scan();                 // Body of the scanner thread
+        bool deliver(const Token& tok);
+        static void discard(Token& tok);   // Free what the parser never took
+    public:
+        explicit PipelinedSource(const reflex::Input in);
+        ~PipelinedSource() override;
+        int yylex(parser::semantic_type* yylval, location* yylloc) override;
+    };
+
+}
+
+#endif //AST_PIPELINEDSOURCE_H
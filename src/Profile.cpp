@@ -0,0 +1,76 @@
+//
+// Execution profiles:  Reading and writing profile files.
+//
+
+#include "Profile.h"
+#include "ASTNode.h"
+#include <string>
+#include <vector>
+
+namespace AST {
+
+    /* Nodes in preorder, which is how a profile file numbers them */
+    static std::vector<ASTNode*> preorder(ASTNode& root) {
+        std::vector<ASTNode*> order;
+        std::vector<ASTNode*> stack{&root};
+        std::vector<ASTNode*> kids;
+        while (! stack.empty()) {
+            ASTNode* node = stack.back();
+            stack.pop_back();
+            order.push_back(node);
+            kids.clear();
+            node->children(kids);
+            // Push in reverse so that the first child comes off first
+            for (auto kid = kids.rbegin(); kid != kids.rend(); ++kid) {
+                stack.push_back(*kid);
+            }
+        }
+        return order;
+    }
+
+    Profile::Counts Profile::counts(const ASTNode* node) const {
+        auto found = counts_.find(node);
+        if (found == counts_.end()) {
+            return Counts{0, 0, 0};
+        }
+        return found->second;
+    }
+
+    int Profile::likely(const ASTNode* node) const {
+        Counts c = counts(node);
+        long total = c.taken + c.not_taken;
+        if (total == 0) { return -1; }
+        if (4 * c.taken >= 3 * total) { return 1; }
+        if (4 * c.not_taken >= 3 * total) { return 0; }
+        return -1;
+    }
+
+    void Profile::write(std::ostream& out, ASTNode& root) const {
+        std::vector<ASTNode*> order = preorder(root);
+        out << "profile " << order.size() << std::endl;
+        for (ASTNode* node : order) {
+            Counts c = counts(node);
+            out << c.hits << " " << c.taken << " " << c.not_taken << std::endl;
+        }
+    }
+
+    bool Profile::read(std::istream& in, ASTNode& root) {
+        std::vector<ASTNode*> order = preorder(root);
+        std::string magic;
+        size_t size;
+        if (! (in >> magic >> size) || magic != "profile" || size != order.size()) {
+            return false;
+        }
+        std::unordered_map<const ASTNode*, Counts> counts;
+        for (ASTNode* node : order) {
+            Counts c;
+            if (! (in >> c.hits >> c.taken >> c.not_taken)) {
+                return false;
+            }
+            counts[node] = c;
+        }
+        counts_.swap(counts);
+        return true;
+    }
+
+}
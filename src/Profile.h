@@ -0,0 +1,58 @@
+//
+// Execution profile (parser -p):  How many times each node of the
+// AST was evaluated, and for each 'if', how many times its condition
+// was true (taken) and false (not taken).
+//
+// Counts are kept by node while we evaluate.  In a profile file a node
+// is known by its position in a preorder walk of the tree, so a
+// profile can be read back for another parse of the same program,
+// e.g., to lay out branches when we generate code (parser -P).
+//
+
+#ifndef AST_PROFILE_H
+#define AST_PROFILE_H
+
+#include <iostream>
+#include <unordered_map>
+
+namespace AST {
+
+    class ASTNode;
+
+    class Profile {
+    public:
+        struct Counts {
+            long hits;
+            long taken;
+            long not_taken;
+        };
+
+        void hit(const ASTNode* node) { ++counts_[node].hits; }
+        void branch(const ASTNode* node, bool taken) {
+            Counts& counts = counts_[node];
+            if (taken) { ++counts.taken; } else { ++counts.not_taken; }
+        }
+
+        /* All zero for a node that was never evaluated */
+        Counts counts(const ASTNode* node) const;
+
+        /* Which way a branch usually goes:  1 if taken at least 3/4
+         * of the time, 0 if not taken at least 3/4 of the time,
+         * -1 if we don't know or it's a toss-up.
+         */
+        int likely(const ASTNode* node) const;
+
+        /* The profile file has a header line, "profile <number of nodes>",
+         * then "hits taken not_taken" for each node in preorder.
+         * read fails (returning false) if the file doesn't match the tree.
+         */
+        void write(std::ostream& out, ASTNode& root) const;
+        bool read(std::istream& in, ASTNode& root);
+
+    private:
+        std::unordered_map<const ASTNode*, Counts> counts_;
+    };
+
+}
+
+#endif //AST_PROFILE_H
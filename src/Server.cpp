@@ -0,0 +1,316 @@
+//
+// Server mode: framed requests in, framed responses out.
+//
+
+#include "Server.h"
+#include "EvalContext.h"
+#include "CodegenContext.h"
+#include "Messages.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* Buffered reads straight from a file descriptor.  We don't go through
+ * std::cin because the same code serves sockets, and because a request
+ * should cost one read() call, not one per character.
+ */
+class FrameReader {
+    int fd_;
+    std::vector<char> buf_;
+    size_t begin_, end_;
+
+    bool fill() {
+        if (begin_ == end_) { begin_ = end_ = 0; }
+        if (end_ == buf_.size()) {
+            if (begin_ > 0) {
+                std::copy(buf_.begin() + begin_, buf_.begin() + end_, buf_.begin());
+                end_ -= begin_;
+                begin_ = 0;
+            } else {
+                buf_.resize(2 * buf_.size());
+            }
+        }
+        ssize_t n;
+        do {
+            n = read(fd_, buf_.data() + end_, buf_.size() - end_);
+        } while (n < 0 && errno == EINTR);
+        if (n <= 0) { return false; }
+        end_ += n;
+        return true;
+    }
+
+public:
+    explicit FrameReader(int fd) : fd_{fd}, buf_(1 << 16), begin_{0}, end_{0} {}
+
+    /* The next line, without its newline.  False at end of input. */
+    bool read_line(std::string& line) {
+        size_t checked = 0;   // Bytes after begin_ that are not a newline
+        for (;;) {
+            const char* from = buf_.data() + begin_ + checked;
+            const char* nl = static_cast<const char*>(memchr(from, '\n', end_ - begin_ - checked));
+            if (nl != nullptr) {
+                line.assign(buf_.data() + begin_, nl - (buf_.data() + begin_));
+                begin_ = (nl - buf_.data()) + 1;
+                return true;
+            }
+            checked = end_ - begin_;
+            if (! fill()) { return false; }
+        }
+    }
+
+    /* Exactly n bytes.  False if the input ends first. */
+    bool read_exact(std::string& text, size_t n) {
+        while (end_ - begin_ < n) {
+            if (! fill()) { return false; }
+        }
+        text.assign(buf_.data() + begin_, n);
+        begin_ += n;
+        return true;
+    }
+};
+
+static bool write_all(int fd, const std::string& data) {
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = write(fd, data.data() + done, data.size() - done);
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n <= 0) { return false; }
+        done += n;
+    }
+    return true;
+}
+
+Server::Server(const governor::Limits& limits, size_t cache_size, size_t max_request) :
+    limits_(limits),
+    cache_size_{cache_size},
+    max_request_{max_request},
+    lexer_(reflex::Input()),
+    parser_(lexer_, &root_),
+    root_{nullptr},
+    limited_(body_.rdbuf()),
+    out_(&limited_),
+    requests_{0},
+    hits_{0},
+    max_latency_{0}
+    { out_.exceptions(std::ios::badbit); }
+
+// Each request so far has the same chance of being in the sample
+void Server::record(long nanos) {
+    ++requests_;
+    max_latency_ = std::max(max_latency_, nanos);
+    if (latencies_.size() < reservoir_size) {
+        latencies_.push_back(nanos);
+        return;
+    }
+    long slot = std::uniform_int_distribution<long>(0, requests_ - 1)(random_);
+    if (slot < (long) reservoir_size) { latencies_[slot] = nanos; }
+}
+
+/* The parsed program for this text, from the cache if we can,
+ * else parsed now and cached.  nullptr if it doesn't parse.
+ */
+Server::Program* Server::lookup(const std::string& text, bool& hit) {
+    auto found = index_.find(text);
+    if (found != index_.end()) {
+        hit = true;
+        programs_.splice(programs_.begin(), programs_, found->second);
+        return &programs_.front();
+    }
+    hit = false;
+    programs_.emplace_front();
+    Program& program = programs_.front();
+    program.text = text;
+    int result;
+    try {
+        AST::NodeArena::Use use(program.nodes);
+        report::reset();
+        root_ = nullptr;
+        lexer_.reset(reflex::Input(program.text.data(), program.text.size()));
+        result = parser_.parse();
+        if (result == 0 && root_ != nullptr) { governor::check_depth(*root_); }
+    } catch (...) {
+        programs_.pop_front();
+        throw;
+    }
+    if (result != 0 || ! report::ok() || root_ == nullptr) {
+        programs_.pop_front();   // Frees whatever was built
+        return nullptr;
+    }
+    program.root = root_;
+    index_[program.text] = programs_.begin();
+    if (programs_.size() > cache_size_) {
+        index_.erase(programs_.back().text);
+        programs_.pop_back();
+    }
+    return &program;
+}
+
+/* Put the response text in body_; true if it is a success */
+bool Server::answer(const std::string& action, const std::string& text, bool& hit) {
+    hit = false;
+    enum { EVAL, JSON, CODEGEN } what;
+    if (action == "eval") {
+        what = EVAL;
+    } else if (action == "json") {
+        what = JSON;
+    } else if (action == "codegen") {
+        what = CODEGEN;
+    } else {
+        body_ << "Unknown action '" << action << "'" << std::endl;
+        return false;
+    }
+    try {
+        governor::start(limits_);
+        limited_.reset();
+        Program* program = lookup(text, hit);
+        if (program == nullptr) {
+            body_ << diagnostics_.str();
+            return false;
+        }
+        AST::ASTNode* root = program->root;
+        switch (what) {
+            case EVAL: {
+                EvalContext ctx;
+                ctx.checked_division = true;
+                out_ << root->eval(ctx) << std::endl;
+                break;
+            }
+            case JSON: {
+                AST::AST_print_context ctx;
+                root->json(out_, ctx);
+                out_ << std::endl;
+                break;
+            }
+            case CODEGEN: {
+                CodegenContext ctx(out_);
+                ctx.emit_prologue();
+                std::string target = ctx.alloc_reg();
+                root->gen_rvalue(ctx, target);
+                ctx.emit_epilogue(target);
+                break;
+            }
+        }
+        return true;
+    } catch (governor::LimitExceeded& e) {
+        out_.clear();
+        body_.str("");
+        body_ << diagnostics_.str() << e.what() << std::endl;
+        return false;
+    } catch (DivisionError& e) {
+        body_.str("");
+        body_ << e.what() << std::endl;
+        return false;
+    } catch (std::exception& e) {
+        // Anything else (say, out of memory) fails this request, not the server
+        out_.clear();
+        body_.str("");
+        body_ << "Internal error: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+void Server::serve(int in_fd, int out_fd) {
+    FrameReader in(in_fd);
+    std::string header, action, text, response;
+    while (in.read_line(header)) {
+        /* A header we can't parse leaves us lost in the input, and
+         * skipping a request too long to read could take forever, so
+         * the only thing to do is answer with an error and quit.
+         */
+        size_t space = header.find(' ');
+        char* end = nullptr;
+        long length = -1;
+        if (space != std::string::npos) {
+            length = strtol(header.c_str() + space + 1, &end, 10);
+        }
+        std::string msg;
+        if (length < 0 || end == nullptr || *end != '\0') {
+            msg = "Bad request header '" + header + "'\n";
+        } else if ((unsigned long) length > max_request_) {
+            msg = "Request of " + std::to_string(length) + " bytes is over the limit of "
+                + std::to_string(max_request_) + "\n";
+        }
+        if (! msg.empty()) {
+            write_all(out_fd, "error " + std::to_string(msg.size()) + " 0 miss\n" + msg);
+            return;
+        }
+        action.assign(header, 0, space);
+        if (! in.read_exact(text, length)) { return; }
+
+        auto start = std::chrono::steady_clock::now();
+        body_.str("");
+        diagnostics_.str("");
+        std::streambuf* saved_cerr = std::cerr.rdbuf(diagnostics_.rdbuf());
+        bool hit;
+        bool ok = answer(action, text, hit);
+        std::cerr.rdbuf(saved_cerr);
+        std::string body = body_.str();
+        long nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+        record(nanos);
+        if (hit) { ++hits_; }
+
+        response = (ok ? "ok " : "error ") + std::to_string(body.size())
+                + " " + std::to_string(nanos / 1000)
+                + (hit ? " hit\n" : " miss\n");
+        response += body;
+        if (! write_all(out_fd, response)) { return; }
+    }
+}
+
+int Server::listen_unix(const std::string& path) {
+    struct sockaddr_un addr;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Socket path too long: " << path << std::endl;
+        return 1;
+    }
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) {
+        std::cerr << "socket: " << strerror(errno) << std::endl;
+        return 1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path.c_str());
+    unlink(path.c_str());
+    if (bind(sock, (struct sockaddr*) &addr, sizeof(addr)) < 0 || listen(sock, 8) < 0) {
+        std::cerr << "Can't listen on " << path << ": " << strerror(errno) << std::endl;
+        close(sock);
+        return 1;
+    }
+    // A client that hangs up early should not kill the server
+    signal(SIGPIPE, SIG_IGN);
+    std::cerr << "Listening on " << path << std::endl;
+    for (;;) {
+        int conn = accept(sock, nullptr, nullptr);
+        if (conn < 0) {
+            if (errno == EINTR) { continue; }
+            std::cerr << "accept: " << strerror(errno) << std::endl;
+            continue;
+        }
+        serve(conn, conn);
+        close(conn);
+    }
+}
+
+void Server::report_stats(std::ostream& out) {
+    if (requests_ == 0) {
+        out << "No requests" << std::endl;
+        return;
+    }
+    std::vector<long> sorted(latencies_);
+    std::sort(sorted.begin(), sorted.end());
+    auto micros = [&sorted](double fraction) {
+        return sorted[(size_t) (fraction * (sorted.size() - 1))] / 1000.0;
+    };
+    out << requests_ << " requests, " << hits_ << " cache hits; "
+        << "latency (us) median " << micros(0.5)
+        << ", 99th percentile " << micros(0.99)
+        << ", max " << max_latency_ / 1000.0 << std::endl;
+}
@@ -0,0 +1,104 @@
+//
+// Server mode (parser -S):  A long-running parser that answers a
+// stream of requests, so that a client pays for process startup,
+// iostream initialization and a cold allocator once instead of for
+// every little program.
+//
+// Requests and responses are each a header line followed by text,
+// with the length of the text in the header:
+//
+//     request:    <action> <length>\n<program text>
+//     response:   <status> <length> <microseconds> <hit|miss>\n<text>
+//
+// The action is eval, json or codegen (C, as with parser -c).  The
+// status is ok, with the result as text, or error, with the
+// diagnostics as text.  Microseconds is the time the server spent on
+// the request, from having read it to starting to write the response,
+// and hit or miss says whether the program came from the cache.
+//
+// The lexer and parser objects and the output buffers are reused from
+// request to request.  Recently parsed programs are kept, each with
+// the arena that owns its nodes, so asking again about the same
+// program text skips the scanner and parser altogether.
+//
+// Each request gets the limits given to the constructor afresh
+// (parser -S -L ...); a request that goes over one gets an error
+// response saying which, and the server carries on.  So does an eval
+// that divides by zero, which would otherwise kill the process.
+//
+
+#ifndef AST_SERVER_H
+#define AST_SERVER_H
+
+#include "TokenSource.h"
+#include "ASTNode.h"
+#include "Governor.h"
+#include <list>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Server {
+public:
+    explicit Server(const governor::Limits& limits, size_t cache_size = 64,
+                    size_t max_request = 16 << 20);
+
+    /* Answer requests from in_fd on out_fd until the end of input
+     * or a request we can't make sense of, which includes one longer
+     * than max_request bytes:  we won't buffer that much.
+     */
+    void serve(int in_fd, int out_fd);
+
+    /* Serve connections to a Unix domain socket at path, one at a
+     * time, forever.  Returns only if the socket can't be set up.
+     */
+    int listen_unix(const std::string& path);
+
+    /* Number of requests, cache hits, and latency percentiles, which
+     * are estimated from a sample of at most 4096 requests
+     */
+    void report_stats(std::ostream& out);
+
+private:
+    /* A cached program; the arena owns all of its nodes */
+    struct Program {
+        std::string text;
+        AST::NodeArena nodes;
+        AST::ASTNode* root;
+    };
+    typedef std::list<Program> ProgramList;
+
+    governor::Limits limits_;
+    size_t cache_size_;
+    size_t max_request_;
+    ProgramList programs_;     // Most recently used first
+    std::unordered_map<std::string, ProgramList::iterator> index_;
+
+    yy::LexerSource lexer_;
+    yy::parser parser_;
+    AST::ASTNode* root_;
+
+    std::ostringstream body_;         // Reused for every response
+    governor::LimitedBuf limited_;    // ... which we write through these
+    std::ostream out_;
+    std::ostringstream diagnostics_;  // Where std::cerr goes during a request
+    long requests_;
+    long hits_;
+
+    /* Latencies in nanoseconds:  the longest, and a uniform sample
+     * of them all (reservoir sampling), so memory stays bounded
+     */
+    static const size_t reservoir_size = 4096;
+    long max_latency_;
+    std::vector<long> latencies_;
+    std::minstd_rand random_;
+
+    void record(long nanos);
+
+    Program* lookup(const std::string& text, bool& hit);
+    bool answer(const std::string& action, const std::string& text, bool& hit);
+};
+
+#endif //AST_SERVER_H
@@ -0,0 +1,82 @@
+//
+// Context for the structured C code generator (parser -C).
+//
+// The ordinary C generator (CodegenContext) translates everything into
+// three-address assignments and gotos, as if C were assembly language.
+// That is easy to retarget, but a C compiler is slow to optimize huge
+// functions made of gotos.  Here we instead write nested C expressions
+// like (a + b) * c and real if/else blocks.  C's && and || are already
+// short-circuit, and calculator conditions have no side effects, so we
+// never need to fall back to gotos for conditions.
+//
+// Declarations all go at the top of main (so that a variable first
+// seen inside an 'if' is still in scope after it), so the body is
+// buffered until the end.
+//
+
+#ifndef AST_STRUCTUREDCODEGENCONTEXT_H
+#define AST_STRUCTUREDCODEGENCONTEXT_H
+
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+class StructuredCodegenContext {
+    int next_reg_num = 0;
+    int indent_ = 1;
+    std::map<std::string, std::string> local_vars;
+    std::vector<std::string> declarations_;
+    std::stringstream body_;
+    std::ostream &object_code;
+public:
+    /* A C compiler drops a division whose value isn't used, and may
+     * find 1 / x without dividing, so neither would trap as in eval.
+     * While this is set, divisions go through volatile temporaries,
+     * which it has to compute.
+     */
+    bool forced_division = false;
+
+    explicit StructuredCodegenContext(std::ostream &out) : object_code{out} {};
+
+    /* One C statement, at the current indentation */
+    void emit(std::string s) {
+        for (int i = 0; i < indent_; ++i) { body_ << "    "; }
+        body_ << s << std::endl;
+    }
+
+    /* Nested blocks:  open("if (x)") ... reopen("else") ... close() */
+    void open(std::string head) { emit(head + " {"); ++indent_; }
+    void reopen(std::string head) { --indent_; emit("} " + head + " {"); ++indent_; }
+    void close() { --indent_; emit("}"); }
+
+    /* Temporaries and calculator variables start out zero, as in eval */
+    std::string alloc_reg() {
+        std::string reg_name = "tmp__" + std::to_string(next_reg_num++);
+        declarations_.push_back("int " + reg_name + " = 0;");
+        return reg_name;
+    }
+
+    std::string get_local_var(std::string &ident) {
+        if (local_vars.count(ident) == 0) {
+            std::string internal = std::string("calc_var_") + ident;
+            local_vars[ident] = internal;
+            declarations_.push_back("int " + internal + " = 0; // Source variable " + ident);
+            return internal;
+        }
+        return local_vars[ident];
+    }
+
+    /* Everything is written out at the end, once we know the declarations */
+    void emit_epilogue(std::string result_reg) {
+        object_code << "#include <stdio.h>" << std::endl;
+        object_code << "int main(int argc, char **argv) {" << std::endl;
+        for (auto& decl : declarations_) { object_code << "    " << decl << std::endl; }
+        object_code << body_.str();
+        object_code << "    printf(\"-> %d\\n\", " << result_reg << ");" << std::endl;
+        object_code << "}" << std::endl;
+    }
+};
+
+#endif //AST_STRUCTUREDCODEGENCONTEXT_H
@@ -0,0 +1,64 @@
+//
+// A fixed-size ring buffer for passing items from exactly one
+// producer thread to exactly one consumer thread, without locks.
+//
+// The producer owns tail_ and the consumer owns head_.  Each side
+// only reads the other side's index, so a release store after writing
+// a slot and an acquire load before reading it are all the
+// synchronization we need.  Each side also keeps a private copy of the
+// other side's index and only re-reads the shared one when the
+// buffer looks full (or empty), which keeps the two cores from
+// fighting over the same cache line on every token.
+//
+
+#ifndef AST_TOKENRING_H
+#define AST_TOKENRING_H
+
+#include <atomic>
+#include <cstddef>
+
+template <typename T, std::size_t Capacity>
+class TokenRing {
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+    static const std::size_t mask_ = Capacity - 1;
+    static const std::size_t line_ = 64;   // Cache line size on the machines we care about
+
+    // Consumer side
+    std::atomic<std::size_t> head_;
+    std::size_t tail_seen_;    // Consumer's last look at tail_
+    char pad_head_[line_];
+    // Producer side
+    std::atomic<std::size_t> tail_;
+    std::size_t head_seen_;    // Producer's last look at head_
+    char pad_tail_[line_];
+
+    T slots_[Capacity];
+public:
+    TokenRing() : head_{0}, tail_seen_{0}, tail_{0}, head_seen_{0} {}
+
+    /* Producer only.  False if the ring is full. */
+    bool push(const T& item) {
+        std::size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_seen_ == Capacity) {
+            head_seen_ = head_.load(std::memory_order_acquire);
+            if (tail - head_seen_ == Capacity) { return false; }
+        }
+        slots_[tail & mask_] = item;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /* Consumer only.  False if the ring is empty. */
+    bool pop(T& item) {
+        std::size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_seen_) {
+            tail_seen_ = tail_.load(std::memory_order_acquire);
+            if (head == tail_seen_) { return false; }
+        }
+        item = slots_[head & mask_];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+#endif //AST_TOKENRING_H
@@ -0,0 +1,41 @@
+//
+// The parser pulls its tokens through a TokenSource rather than
+// directly from the RE/flex generated yy::Lexer, so that we can put
+// something between the scanner and the parser (e.g., a separate
+// scanner thread) without the parser knowing about it.
+//
+
+#ifndef AST_TOKENSOURCE_H
+#define AST_TOKENSOURCE_H
+
+#include "calc.tab.hxx"
+#include "lex.yy.h"
+#include "Governor.h"
+
+namespace yy {
+
+    /* Anything with a yylex that fills in the semantic value
+     * and the location, just like the one reflex generates.
+     */
+    class TokenSource {
+    public:
+        virtual ~TokenSource() {}
+        virtual int yylex(parser::semantic_type* yylval, location* yylloc) = 0;
+    };
+
+    /* The ordinary case:  Just pass the call along to the reflex scanner. */
+    class LexerSource : public TokenSource {
+        Lexer lexer_;
+    public:
+        explicit LexerSource(const reflex::Input in) : lexer_(in) {}
+        /* Start over on new input, keeping the scanner's buffers */
+        void reset(const reflex::Input in) { lexer_.in(in); }
+        int yylex(parser::semantic_type* yylval, location* yylloc) override {
+            governor::charge_token();
+            return lexer_.yylex(yylval, yylloc);
+        }
+    };
+
+}
+
+#endif //AST_TOKENSOURCE_H
@@ -0,0 +1,94 @@
+//
+// Work-stealing thread pool; see WorkPool.h
+//
+
+#include "WorkPool.h"
+#include <chrono>
+
+thread_local WorkPool* WorkPool::current_pool_ = nullptr;
+thread_local int WorkPool::current_queue_ = 0;
+
+WorkPool::WorkPool(int workers) : stopping_{false}, queued_{0} {
+    if (workers < 1) { workers = 1; }
+    for (int i = 0; i <= workers; ++i) {
+        queues_.push_back(new Queue());
+    }
+    for (int i = 0; i < workers; ++i) {
+        threads_.emplace_back(&WorkPool::work, this, i);
+    }
+}
+
+WorkPool::~WorkPool() {
+    {
+        std::lock_guard<std::mutex> guard(idle_lock_);
+        stopping_.store(true);
+    }
+    idle_.notify_all();
+    for (auto& t : threads_) { t.join(); }
+    for (auto q : queues_) { delete q; }
+}
+
+/* Workers have their own queue; everyone else shares the last one */
+int WorkPool::my_queue() {
+    if (current_pool_ == this) { return current_queue_; }
+    return static_cast<int>(queues_.size()) - 1;
+}
+
+void WorkPool::submit(Task task) {
+    Queue* q = queues_[my_queue()];
+    {
+        std::lock_guard<std::mutex> guard(q->lock);
+        q->tasks.push_back(std::move(task));
+    }
+    queued_.fetch_add(1);
+    // Taking the idle lock means a worker can't miss the
+    // notification between checking queued_ and going to sleep.
+    { std::lock_guard<std::mutex> guard(idle_lock_); }
+    idle_.notify_one();
+}
+
+/* Run one task if we can find one:  Our own newest first, then
+ * the oldest task in someone else's queue.
+ */
+bool WorkPool::run_one(int self) {
+    Task task;
+    int n = static_cast<int>(queues_.size());
+    for (int i = 0; i < n && ! task; ++i) {
+        int victim = (self + i) % n;
+        Queue* q = queues_[victim];
+        std::lock_guard<std::mutex> guard(q->lock);
+        if (q->tasks.empty()) { continue; }
+        if (victim == self) {
+            task = std::move(q->tasks.back());
+            q->tasks.pop_back();
+        } else {
+            task = std::move(q->tasks.front());
+            q->tasks.pop_front();
+        }
+    }
+    if (! task) { return false; }
+    queued_.fetch_sub(1);
+    task();
+    return true;
+}
+
+void WorkPool::work(int self) {
+    current_pool_ = this;
+    current_queue_ = self;
+    while (true) {
+        if (run_one(self)) { continue; }
+        std::unique_lock<std::mutex> guard(idle_lock_);
+        idle_.wait(guard, [this] { return stopping_.load() || queued_.load() > 0; });
+        if (stopping_.load()) { return; }
+    }
+}
+
+void WorkPool::help_while(const std::function<bool()>& busy) {
+    int self = my_queue();
+    while (busy()) {
+        if (! run_one(self)) {
+            // Whatever we wait for is running on another thread
+            std::this_thread::yield();
+        }
+    }
+}
@@ -0,0 +1,63 @@
+//
+// A small work-stealing thread pool.
+//
+// Each worker has its own deque of tasks.  A worker takes new work
+// from the back of its own deque (most recently spawned first, which
+// keeps related work on the same core) and, when that runs dry,
+// steals from the front of some other worker's deque.  Tasks
+// submitted from threads outside the pool go into one shared deque
+// that every worker steals from.
+//
+// A thread that has to wait for some tasks to finish should not just
+// block; it calls help_while, which runs pool tasks until the wait is
+// over.  That way nested parallel work cannot deadlock the pool.
+//
+
+#ifndef AST_WORKPOOL_H
+#define AST_WORKPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkPool {
+public:
+    typedef std::function<void()> Task;
+
+    explicit WorkPool(int workers);
+    ~WorkPool();
+
+    void submit(Task task);
+
+    /* Run pool tasks (or at least stay out of the way)
+     * until busy() becomes false.
+     */
+    void help_while(const std::function<bool()>& busy);
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+    // One queue per worker, plus a last one for outside threads
+    std::vector<Queue*> queues_;
+    std::vector<std::thread> threads_;
+    std::atomic<bool> stopping_;
+    std::atomic<int> queued_;          // Tasks sitting in any queue
+    std::mutex idle_lock_;
+    std::condition_variable idle_;
+
+    // Which pool (if any) the current thread works for, and its queue
+    static thread_local WorkPool* current_pool_;
+    static thread_local int current_queue_;
+
+    int my_queue();
+    bool run_one(int self);
+    void work(int self);
+};
+
+#endif //AST_WORKPOOL_H
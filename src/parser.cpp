@@ -4,21 +4,68 @@
 //
 
 #include "lex.yy.h"
+#include "TokenSource.h"
+#include "PipelinedSource.h"
 #include "ASTNode.h"
 #include "EvalContext.h"
+#include "ParallelEval.h"
+#include "AsmCodegenContext.h"
+#include "StructuredCodegenContext.h"
+#include "IR.h"
+#include "Server.h"
+#include "Governor.h"
 #include "Messages.h"
+#include "Profile.h"
+#include "PartialEval.h"
+#include "NodeFactory.h"
+#include "FastScanner.h"
+#include "DescentParser.h"
 #include <unistd.h>
 #include <iostream>
+#include <fstream>
+#include <climits>
+#include <map>
+#include <thread>
+
+/* The reflex scanner.  With 'pipelined', the scanner runs in its own
+ * thread and hands tokens to the parser through a ring buffer, if
+ * there is a second core for it; on one core that only costs time
+ * (bench/pipeline_time.sh).
+ */
+yy::TokenSource* reflex_scanner(const reflex::Input in, bool pipelined) {
+    if (pipelined) {
+        if (std::thread::hardware_concurrency() > 1) { return new yy::PipelinedSource(in); }
+        std::cerr << "Only one core; -t ignored" << std::endl;
+    }
+    return new yy::LexerSource(in);
+}
 
 class Driver {
 public:
-    explicit Driver(const reflex::Input in) : lexer(in), parser(new yy::parser(lexer, &root))
+    /* The driver deletes the token source when it's done.
+     * With 'hash_cons', identical leaves and arithmetic are shared.
+     * With 'descent', the hand-written parser is used instead of Bison's.
+     */
+    explicit Driver(yy::TokenSource* source, bool hash_cons = false, bool descent = false) :
+        lexer(source),
+        parser(new yy::parser(*lexer, &root)),
+        descent(descent ? new yy::DescentParser(*lexer, &root) : nullptr),
+        hash_cons(hash_cons)
        { root = nullptr; }
-    ~Driver() { delete parser; }
+    ~Driver() { delete parser; delete descent; delete lexer; }
     AST::ASTNode* parse() {
         // parser->set_debug_level(1); // 0 = no debugging, 1 = full tracing
         // std::cout << "Running parser\n";
-        int result = parser->parse();
+        AST::NodeFactory factory;
+        int result;
+        if (hash_cons) {
+            AST::NodeFactory::Use use(factory);
+            result = run_parser();
+            std::cerr << "Hash-consing built " << factory.built() << " leaf and arithmetic nodes, shared "
+                      << factory.shared() << std::endl;
+        } else {
+            result = run_parser();
+        }
         if (result == 0 && report::ok()) {  // 0 == success, 1 == failure
             // std::cout << "Extracting result\n";
             if (root == nullptr) {
@@ -31,23 +78,50 @@ public:
         }
     }
 private:
-    yy::Lexer   lexer;
+    int run_parser() { return descent ? descent->parse() : parser->parse(); }
+    yy::TokenSource *lexer;
     yy::parser *parser;
+    yy::DescentParser *descent;
     AST::ASTNode *root;
+    bool hash_cons;
 };
 
-void generate_code(AST::ASTNode *root) {
-    CodegenContext ctx(std::cout);
+/* The context decides the target language: C for
+ * CodegenContext, assembly language for AsmCodegenContext.
+ */
+void generate_code(AST::ASTNode *root, CodegenContext& ctx) {
     // Prologue
-    ctx.emit("#include <stdio.h>");
-    ctx.emit("int main(int argc, char **argv) {");
+    ctx.emit_prologue();
     // Body of generated code
     std::string target = ctx.alloc_reg();
     root->gen_rvalue(ctx, target);
     // Coda
-    ctx.emit(std::string(R"(printf("-> %d\n",)")
-        + target + ");");
-    ctx.emit("}");
+    ctx.emit_epilogue(target);
+}
+
+/* Lower the whole program to SSA form, optionally optimized */
+ir::Function* lower_program(AST::ASTNode *root, bool optimize) {
+    ir::Function* fn = new ir::Function();
+    ir::Builder builder(*fn);
+    ir::Instr* result = root->lower(builder);
+    builder.ret(result);
+    fn->layout();
+    if (optimize) {
+        ir::optimize(*fn);
+    }
+    return fn;
+}
+
+/* Add a binding from "name=value" (parser -D).  False if malformed. */
+bool define(std::map<std::string, int>& known, const std::string& binding) {
+    size_t eq = binding.find('=');
+    if (eq == 0 || eq == std::string::npos) { return false; }
+    const char* digits = binding.c_str() + eq + 1;
+    char* end;
+    long value = strtol(digits, &end, 10);
+    if (*end != '\0' || end == digits || value < INT_MIN || value > INT_MAX) { return false; }
+    known[binding.substr(0, eq)] = (int) value;
+    return true;
 }
 
 int main(int argc, char **argv)
@@ -57,49 +131,206 @@ int main(int argc, char **argv)
     /* Choices of output */
     int json = 0;
     int codegen = 0;
+    int structured = 0;
+    int asmgen = 0;
     int calcmode = 0;
+    /* Scan in a separate thread? */
+    int pipelined = 0;
+    /* Evaluate independent statements in parallel with this many threads */
+    int workers = 0;
+    /* Go through the SSA intermediate representation?  Dump it?  Optimize it? */
+    int use_ir = 0;
+    int dump_ir = 0;
+    int optimize = 0;
+    /* Answer a stream of requests, on stdin or a Unix domain socket */
+    int serve = 0;
+    const char* socket_path = nullptr;
+    /* Profile evaluation into a file?  Or use a profile from a file? */
+    const char* profile_out = nullptr;
+    const char* profile_in = nullptr;
+    /* Turn chains of x == 1 ... elif x == 2 ... into switches? */
+    int switches = 0;
+    /* Use the hand-written scanner instead of the reflex one? */
+    int fast_scan = 0;
+    /* Parse by recursive descent instead of with the Bison parser? */
+    int descent = 0;
+    /* Share identical leaves and arithmetic subtrees? */
+    int hash_cons = 0;
+    /* Variables whose values we know, from -D name=value, to specialize for */
+    std::map<std::string, int> known;
+    /* Limits on tokens, nodes, depth, time and output, from -L name=value */
+    governor::Limits limits;
     char opt;
-    while ((opt = getopt (argc, argv, "jce")) != -1) {
+    while ((opt = getopt (argc, argv, "jcCestw:irOSu:p:P:mL:D:HFd")) != -1) {
         if (opt == 'j') { json = 1; }
         if (opt == 'e') { calcmode = 1;}
         if (opt == 'c') { codegen = 1; }
-    }
-    // The remaining argument should be a file name
-    if (optind < argc) {
-        const char* path = argv[optind];
-        std::cerr << "Reading from file " << path << std::endl;
-        FILE *f = fopen(path, "r");
-        if (! f) {
-            std::cerr << "Open failed on '" << path << "'" << std::endl;
+        if (opt == 'C') { structured = 1; }
+        if (opt == 's') { asmgen = 1; }
+        if (opt == 't') { pipelined = 1; }
+        if (opt == 'w') { workers = atoi(optarg); }
+        if (opt == 'i') { use_ir = 1; }
+        if (opt == 'r') { dump_ir = 1; }
+        if (opt == 'O') { optimize = 1; use_ir = 1; }
+        if (opt == 'S') { serve = 1; }
+        if (opt == 'u') { serve = 1; socket_path = optarg; }
+        if (opt == 'p') { profile_out = optarg; }
+        if (opt == 'P') { profile_in = optarg; }
+        if (opt == 'm') { switches = 1; }
+        if (opt == 'H') { hash_cons = 1; }
+        if (opt == 'F') { fast_scan = 1; }
+        if (opt == 'd') { descent = 1; }
+        if (opt == 'L' && ! governor::set_limit(limits, optarg)) {
+            std::cerr << "Bad limit '" << optarg << "'; expected tokens, nodes, depth, "
+                      << "time (ms) or output (bytes), as in -L nodes=100000" << std::endl;
+            exit(5);
+        }
+        if (opt == 'D' && ! define(known, optarg)) {
+            std::cerr << "Bad binding '" << optarg << "'; expected name=integer, as in -D x=3" << std::endl;
             exit(5);
         }
-        std::cerr << "Opened " << argv[optind] << std::endl;
-        Driver driver(f);
-        root = driver.parse();
-    } else {
-        std::cerr << "Reading from stdin" << std::endl;
-        Driver driver(&std::cin);
-        root = driver.parse();
     }
-    if (root != nullptr) {
-        std::cerr << "Parsed!\n";
-        if (json) {
-            AST::AST_print_context context;
-            root->json(std::cout, context);
-            std::cout << std::endl;
+    if (fast_scan && pipelined) {
+        std::cerr << "-F and -t don't go together:  only the reflex scanner can run "
+                  << "in a thread of its own" << std::endl;
+        exit(5);
+    }
+    if (serve && (fast_scan || pipelined || descent || hash_cons || switches || ! known.empty())) {
+        std::cerr << "-F, -t, -d, -H, -m and -D don't go with -S or -u:  the server always parses "
+                  << "and evaluates programs as they are" << std::endl;
+        exit(5);
+    }
+    if (serve) {
+        Server server(limits);
+        int status = 0;
+        if (socket_path) {
+            status = server.listen_unix(socket_path);
+        } else {
+            server.serve(0, 1);
         }
-        if (calcmode) {
-            auto ctx = EvalContext();
-            std::cout << "Evaluates to " << root->eval(ctx) << std::endl;
-            exit(0);
+        server.report_stats(std::cerr);
+        exit(status);
+    }
+    /* Guard against runaway input:  Everything from here on
+     * throws governor::LimitExceeded if it goes over a limit.
+     */
+    governor::start(limits);
+    governor::LimitedBuf limited_out(std::cout.rdbuf());
+    std::streambuf* plain_out = std::cout.rdbuf();
+    if (limits.output_bytes > 0 || limits.millis > 0) {
+        std::cout.rdbuf(&limited_out);
+        std::cout.exceptions(std::ios::badbit);
+    }
+    try {
+        // The remaining argument should be a file name
+        if (optind < argc) {
+            const char* path = argv[optind];
+            std::cerr << "Reading from file " << path << std::endl;
+            FILE *f = fopen(path, "r");
+            if (! f) {
+                std::cerr << "Open failed on '" << path << "'" << std::endl;
+                exit(5);
+            }
+            std::cerr << "Opened " << argv[optind] << std::endl;
+            Driver driver(fast_scan ? new yy::FastScanner(f) : reflex_scanner(f, pipelined), hash_cons, descent);
+            root = driver.parse();
+        } else {
+            std::cerr << "Reading from stdin" << std::endl;
+            Driver driver(fast_scan ? new yy::FastScanner(std::cin) : reflex_scanner(&std::cin, pipelined),
+                          hash_cons, descent);
+            root = driver.parse();
         }
-        if (codegen) {
-            std::cout << "/* BEGIN GENERATED CODE */" << std::endl;
-            generate_code(root);
-            std::cout << "/* END GENERATED CODE */" << std::endl;
+        if (root != nullptr) {
+            std::cerr << "Parsed!\n";
+            governor::check_depth(*root);
+            if (switches) {
+                AST::make_switches(*root);
+            }
+            /* With -D, everything below works on the residual program */
+            if (! known.empty()) {
+                AST::PartialEval pe(known);
+                root = pe.residual(*dynamic_cast<AST::Block*>(root));
+            }
+            /* With -p, evaluate once with counting, and the json and
+             * code generated below get the counts too.
+             */
+            AST::Profile profile;
+            AST::Profile* have_profile = nullptr;
+            if (profile_out) {
+                auto ctx = EvalContext();
+                ctx.profile = &profile;
+                int value = root->eval(ctx);
+                std::ofstream out(profile_out);
+                profile.write(out, *root);
+                if (! out) {
+                    std::cerr << "Could not write profile to '" << profile_out << "'" << std::endl;
+                    exit(5);
+                }
+                std::cerr << "Profiled, evaluates to " << value << std::endl;
+                have_profile = &profile;
+            }
+            if (profile_in) {
+                std::ifstream in(profile_in);
+                if (! profile.read(in, *root)) {
+                    std::cerr << "Profile '" << profile_in << "' is missing or not for this program" << std::endl;
+                    exit(5);
+                }
+                have_profile = &profile;
+            }
+            if (json) {
+                AST::AST_print_context context;
+                context.profile_ = have_profile;
+                root->json(std::cout, context);
+                std::cout << std::endl;
+            }
+            if (calcmode) {
+                auto ctx = EvalContext();
+                if (workers > 0) {
+                    AST::ParallelEval parallel(workers);
+                    std::cout << "Evaluates to " << parallel.eval(*root, ctx) << std::endl;
+                } else {
+                    std::cout << "Evaluates to " << root->eval(ctx) << std::endl;
+                }
+                exit(0);
+            }
+            ir::Function* fn = nullptr;
+            if (use_ir || dump_ir) {
+                fn = lower_program(root, optimize);
+            }
+            if (dump_ir) {
+                fn->dump(std::cout);
+            }
+            if (codegen) {
+                std::cout << "/* BEGIN GENERATED CODE */" << std::endl;
+                CodegenContext ctx(std::cout);
+                ctx.profile = have_profile;
+                if (use_ir) { ctx.emit_function(*fn); } else { generate_code(root, ctx); }
+                std::cout << "/* END GENERATED CODE */" << std::endl;
+            }
+            if (structured) {
+                std::cout << "/* BEGIN GENERATED CODE */" << std::endl;
+                StructuredCodegenContext ctx(std::cout);
+                std::string target = ctx.alloc_reg();
+                root->gen_structured(ctx, target);
+                ctx.emit_epilogue(target);
+                std::cout << "/* END GENERATED CODE */" << std::endl;
+            }
+            if (asmgen) {
+                std::cout << "# BEGIN GENERATED CODE" << std::endl;
+                AsmCodegenContext ctx(std::cout);
+                ctx.profile = have_profile;
+                if (use_ir) { ctx.emit_function(*fn); } else { generate_code(root, ctx); }
+                std::cout << "# END GENERATED CODE" << std::endl;
+            }
+            delete fn;
+        } else {
+            std::cerr << "Extracted root was nullptr" << std::endl;
+            exit(1);
         }
-    } else {
-        std::cerr << "Extracted root was nullptr" << std::endl;
-        exit(1);
+    } catch (governor::LimitExceeded& e) {
+        std::cout.rdbuf(plain_out);
+        std::cerr << "Failed: " << e.what() << std::endl;
+        exit(3);
     }
+    std::cout.rdbuf(plain_out);
 }
@@ -4,8 +4,24 @@
 
 
 #include <iostream>
+#include <climits>
+#include <csignal>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <sys/wait.h>
 #include "ASTNode.h"
+#include "AsmCodegenContext.h"
 #include "EvalContext.h"
+#include "IncrementalEval.h"
+#include "IR.h"
+#include "NodeFactory.h"
+#include "ParallelEval.h"
+#include "PartialEval.h"
+#include "StructuredCodegenContext.h"
 
 using namespace AST;
 
@@ -41,12 +57,532 @@ void all_the_concrete_classes() {
     Block block;
     Assign assign = Assign(ident, intconst);
     (void) assign;  // Suppress unused variable warning
+    Switch multiway(ident, {{1, &block}, {2, &block}, {7, &block}}, block);
 
 
     return;
 }
 
 
+// Incremental re-evaluation should agree with evaluating
+// the whole block again.
+//   a = x + 1
+//   b = y * 2
+//   if a < 4 then c = a else c = b fi
+//   c + a
+void incremental_test() {
+    Ident &x = *new Ident("x"), &y = *new Ident("y");
+    Ident &a = *new Ident("a"), &b = *new Ident("b"), &c = *new Ident("c");
+    Block program;
+    program.append(new Assign(a, *new Plus(x, *new IntConst(1))));
+    program.append(new Assign(b, *new Times(y, *new IntConst(2))));
+    Block *then_part = new Block(), *else_part = new Block();
+    then_part->append(new Assign(c, a));
+    else_part->append(new Assign(c, b));
+    program.append(new If(*new Less(a, *new IntConst(4)), *then_part, *else_part));
+    program.append(new Plus(c, a));
+
+    // The inputs so far, kept apart from anything IncrementalEval touches
+    std::unordered_map<std::string, int> inputs{{"x", 1}};
+    EvalContext inc_ctx;
+    inc_ctx.symtab = inputs;
+    IncrementalEval inc(program);
+    inc.eval(inc_ctx);
+    for (int step = 0; step < 6; ++step) {
+        std::unordered_map<std::string, int> changed;
+        changed[step % 2 ? "x" : "y"] = step;
+        inputs[step % 2 ? "x" : "y"] = step;
+        int got = inc.update(changed, inc_ctx);
+
+        EvalContext full_ctx;
+        full_ctx.symtab = inputs;
+        int want = program.eval(full_ctx);
+        assert(got == want);
+        assert(inc_ctx.symtab == full_ctx.symtab);
+    }
+    std::cout << "Incremental evaluation agrees with full evaluation" << std::endl;
+}
+
+
+// Parallel evaluation should agree with ASTNode::eval, in the value
+// and in every variable, however many workers there are:
+//   a = b + 1; b = 5; a + b            (read before a later write)
+//   a = 1; a = a * 3 + 2; c = a; a = 7; c + a     (two writes)
+//   if b < 4 then c = b * 2; d = 1 else c = 0 fi; c + d
+//   v<i % 7> = v<(i + 3) % 7> + i, 3000 times   (many tasks)
+void parallel_test() {
+    Ident &a = *new Ident("a"), &b = *new Ident("b");
+    Ident &c = *new Ident("c"), &d = *new Ident("d");
+    std::vector<Block*> programs;
+
+    Block* reads = new Block();
+    reads->append(new Assign(a, *new Plus(b, *new IntConst(1))));
+    reads->append(new Assign(b, *new IntConst(5)));
+    reads->append(new Plus(a, b));
+    programs.push_back(reads);
+
+    Block* writes = new Block();
+    writes->append(new Assign(a, *new IntConst(1)));
+    writes->append(new Assign(a, *new Plus(*new Times(a, *new IntConst(3)), *new IntConst(2))));
+    writes->append(new Assign(c, a));
+    writes->append(new Assign(a, *new IntConst(7)));
+    writes->append(new Plus(c, a));
+    programs.push_back(writes);
+
+    Block *then_part = new Block(), *else_part = new Block();
+    then_part->append(new Assign(c, *new Times(b, *new IntConst(2))));
+    then_part->append(new Assign(d, *new IntConst(1)));
+    else_part->append(new Assign(c, *new IntConst(0)));
+    Block* branch = new Block();
+    branch->append(new If(*new Less(b, *new IntConst(4)), *then_part, *else_part));
+    branch->append(new Plus(c, d));
+    programs.push_back(branch);
+
+    Block* many = new Block();
+    for (int i = 0; i < 3000; ++i) {
+        Ident& to = *new Ident("v" + std::to_string(i % 7));
+        Ident& from = *new Ident("v" + std::to_string((i + 3) % 7));
+        many->append(new Assign(to, *new Plus(from, *new IntConst(i))));
+    }
+    many->append(new Plus(*new Ident("v0"), *new Ident("v6")));
+    programs.push_back(many);
+
+    for (Block* program : programs) {
+        for (int start : {2, 9}) {
+            EvalContext serial_ctx;
+            serial_ctx.symtab["b"] = start;
+            int want = program->eval(serial_ctx);
+            for (int workers : {2, 3}) {
+                EvalContext parallel_ctx;
+                parallel_ctx.symtab["b"] = start;
+                ParallelEval parallel(workers);
+                int got = parallel.eval(*program, parallel_ctx);
+                assert(got == want);
+                assert(parallel_ctx.symtab == serial_ctx.symtab);
+            }
+        }
+    }
+    std::cout << "Parallel evaluation agrees with evaluation" << std::endl;
+}
+
+
+/* (a + 3) * (a + 3) - (a - 3) / (3 + a), through the factory */
+ASTNode* factory_expr() {
+    typedef NodeFactory F;
+    ASTNode* sum = F::binop<Plus>(*F::ident("a"), *F::constant(3));
+    ASTNode* again = F::binop<Plus>(*F::ident("a"), *F::constant(3));
+    ASTNode* diff = F::binop<Minus>(*F::ident("a"), *F::constant(3));
+    ASTNode* flipped = F::binop<Plus>(*F::constant(3), *F::ident("a"));
+    return F::binop<Minus>(*F::binop<Times>(*sum, *again), *F::binop<Div>(*diff, *flipped));
+}
+
+// Hash-consing should give the same node for the same leaf or the
+// same operator on the same children, and nothing else, without
+// changing what the program computes.
+void hash_cons_test() {
+    NodeArena nodes;
+    NodeArena::Use use(nodes);
+    ASTNode* plain = factory_expr();
+    NodeFactory factory;
+    ASTNode *shared, *again;
+    {
+        NodeFactory::Use sharing(factory);
+        assert(NodeFactory::ident("a") == NodeFactory::ident("a"));
+        assert(NodeFactory::ident("a") != NodeFactory::ident("b"));
+        assert(NodeFactory::constant(3) == NodeFactory::constant(3));
+        assert(NodeFactory::constant(3) != NodeFactory::constant(4));
+        assert(factory.built() == 4 && factory.shared() == 4);
+
+        // a + 3, a - 3, 3 + a, *, / and the outer - are built;
+        // the second a + 3 and all eight a's and 3's are shared.
+        // The second time, every one of the 15 nodes is shared.
+        shared = factory_expr();
+        assert(factory.built() == 4 + 6);
+        assert(factory.shared() == 4 + 9);
+        again = factory_expr();
+        assert(again == shared);
+        assert(factory.built() == 10);
+        assert(factory.shared() == 13 + 15);
+
+        std::vector<ASTNode*> kids;
+        shared->children(kids);
+        ASTNode* product = kids[0];
+        ASTNode* quotient = kids[1];
+        kids.clear();
+        product->children(kids);
+        assert(kids[0] == kids[1]);                 // a + 3, twice
+        ASTNode* sum = kids[0];
+        kids.clear();
+        quotient->children(kids);
+        assert(kids[0] != sum && kids[1] != sum);   // a - 3 and 3 + a aren't a + 3
+        assert(kids[0] != kids[1]);
+        assert(NodeFactory::binop<Times>(*sum, *sum) != NodeFactory::binop<Plus>(*sum, *sum));
+    }
+    assert(factory_expr() != shared);               // No factory in use, nothing shared
+
+    Block *shared_program = new Block(), *plain_program = new Block();
+    for (Block* program : {shared_program, plain_program}) {
+        program->append(new Assign(*new Ident("a"), *new IntConst(4)));
+    }
+    shared_program->append(shared);
+    plain_program->append(plain);
+    EvalContext shared_ctx, plain_ctx;
+    assert(shared_program->eval(shared_ctx) == plain_program->eval(plain_ctx));
+    assert(shared_ctx.symtab == plain_ctx.symtab);
+    std::cout << "Hash-consing shares exactly the identical subtrees" << std::endl;
+}
+
+
+/* Run the IR the way the generated code would */
+int run_ir(ir::Function& fn) {
+    std::map<ir::Instr*, int> values;
+    ir::BasicBlock* block = fn.blocks[0];
+    ir::BasicBlock* from = nullptr;
+    for (;;) {
+        for (ir::Instr* instr : block->instrs) {
+            if (instr->op == ir::Const) { values[instr] = instr->imm; continue; }
+            if (instr->op == ir::Phi) {
+                for (size_t i = 0; i < block->preds.size(); ++i) {
+                    if (block->preds[i] == from) { values[instr] = values[ir::resolve(instr->args[i])]; }
+                }
+                continue;
+            }
+            volatile int l = values[ir::resolve(instr->args[0])];
+            volatile int r = values[ir::resolve(instr->args[1])];
+            switch (instr->op) {
+                case ir::Add: values[instr] = l + r; break;
+                case ir::Sub: values[instr] = l - r; break;
+                case ir::Mul: values[instr] = l * r; break;
+                case ir::Div: values[instr] = l / r; break;
+                case ir::Less: values[instr] = l < r; break;
+                case ir::AtMost: values[instr] = l <= r; break;
+                case ir::Greater: values[instr] = l > r; break;
+                case ir::AtLeast: values[instr] = l >= r; break;
+                default: values[instr] = l == r; break;
+            }
+        }
+        if (block->term == ir::BasicBlock::Return) { return values[ir::resolve(block->value)]; }
+        from = block;
+        if (block->term == ir::BasicBlock::Jump) {
+            block = block->succs[0];
+        } else {
+            block = block->succs[values[ir::resolve(block->value)] ? 0 : 1];
+        }
+    }
+}
+
+/* Run 'run' in a child process:  what it returns, or the signal that killed it */
+template <class Run>
+std::string outcome(Run run) {
+    int pipefd[2];
+    if (pipe(pipefd) != 0) { return "no pipe"; }
+    pid_t pid = fork();
+    if (pid == 0) {
+        int value = run();
+        ssize_t written = write(pipefd[1], &value, sizeof value);
+        _exit(written == sizeof value ? 0 : 1);
+    }
+    close(pipefd[1]);
+    int value = 0;
+    ssize_t got = read(pipefd[0], &value, sizeof value);
+    close(pipefd[0]);
+    int status;
+    waitpid(pid, &status, 0);
+    if (WIFSIGNALED(status)) { return std::string("signal ") + std::to_string(WTERMSIG(status)); }
+    return got == sizeof value ? std::to_string(value) : "no value";
+}
+
+// A division whose value isn't used must still trap after -O
+// if it traps in -e:  by zero, by an unknown divisor, INT_MIN / -1.
+// One that can't trap may go.
+//   x = <dividend> / <divisor>
+//   5
+void dead_division_test() {
+    Ident &x = *new Ident("x"), &y = *new Ident("y");
+    IntConst& int_min = *new IntConst(INT_MIN);
+    struct { ASTNode* dividend; ASTNode* divisor; } cases[] = {
+        {new IntConst(1), new IntConst(0)},
+        {new IntConst(1), &y},
+        {&int_min, new IntConst(-1)},
+        {&y, new IntConst(-1)},
+        {new IntConst(7), new IntConst(2)},
+        {new IntConst(7), new IntConst(-1)},
+    };
+    for (auto& c : cases) {
+        Block program;
+        program.append(new Assign(x, *new Div(*c.dividend, *c.divisor)));
+        program.append(new IntConst(5));
+        std::string evaluated = outcome([&] { EvalContext ctx; return program.eval(ctx); });
+        std::string optimized = outcome([&] {
+            ir::Function fn;
+            ir::Builder builder(fn);
+            builder.ret(program.lower(builder));
+            fn.layout();
+            ir::optimize(fn);
+            return run_ir(fn);
+        });
+        if (evaluated != optimized) {
+            std::cout << program.str() << ":  -e gives " << evaluated << ", -O " << optimized << std::endl;
+        }
+        assert(evaluated == optimized);
+    }
+    std::cout << "Optimized IR traps where evaluation does" << std::endl;
+}
+
+
+// Partial evaluation mustn't drop a statement that traps, even when
+// its value isn't used.  With -D x=1, the residual of
+//   x = 1
+//   <dividend> / <divisor>
+//   7
+// must trap where the program does.
+void residual_division_test() {
+    Ident &x = *new Ident("x"), &y = *new Ident("y");
+    ASTNode& int_min = *new Minus(*new Minus(*new IntConst(0), *new IntConst(INT_MAX)), *new IntConst(1));
+    struct { ASTNode* dividend; ASTNode* divisor; } cases[] = {
+        {new IntConst(5), &y},
+        {new IntConst(5), new IntConst(0)},
+        {new IntConst(5), new Minus(x, *new IntConst(1))},
+        {&int_min, new IntConst(-1)},
+        {&x, new IntConst(2)},
+        {&y, new IntConst(-1)},
+    };
+    for (auto& c : cases) {
+        Block program;
+        program.append(new Assign(x, *new IntConst(1)));
+        program.append(new Div(*c.dividend, *c.divisor));
+        program.append(new IntConst(7));
+        std::string evaluated = outcome([&] { EvalContext ctx; return program.eval(ctx); });
+        std::string specialized = outcome([&] {
+            PartialEval pe({{"x", 1}});
+            Block* residual = pe.residual(program);
+            EvalContext ctx;
+            ctx.symtab["x"] = 1;
+            return residual->eval(ctx);
+        });
+        if (evaluated != specialized) {
+            std::cout << program.str() << ":  -e gives " << evaluated << ", -D x=1 " << specialized << std::endl;
+        }
+        assert(evaluated == specialized);
+    }
+    std::cout << "Residual programs trap where the program does" << std::endl;
+}
+
+
+/* Build source (C, or assembly if suffix is ".s") with cc and run it:
+ * what it prints, or the signal that killed it, as from outcome.
+ */
+std::string compiled_outcome(const std::string& source, const std::string& suffix) {
+    std::string exe = "/tmp/test_ast_" + std::to_string(getpid());
+    std::ofstream(exe + suffix) << source;
+    if (system(("cc -O2 -o " + exe + " " + exe + suffix).c_str()) != 0) { return "no compile"; }
+    FILE* run = popen(("exec " + exe).c_str(), "r");
+    int value = 0;
+    bool got = fscanf(run, "-> %d", &value) == 1;
+    int status = pclose(run);
+    remove((exe + suffix).c_str());
+    remove(exe.c_str());
+    if (WIFSIGNALED(status)) { return std::string("signal ") + std::to_string(WTERMSIG(status)); }
+    return got ? std::to_string(value) : "no value";
+}
+
+/* The program as parser -C would translate it, compiled and run */
+std::string structured_outcome(ASTNode& program) {
+    std::stringstream source;
+    StructuredCodegenContext ctx(source);
+    std::string target = ctx.alloc_reg();
+    program.gen_structured(ctx, target);
+    ctx.emit_epilogue(target);
+    return compiled_outcome(source.str(), ".c");
+}
+
+/* The program as parser -s would translate it, assembled and run */
+std::string asm_outcome(ASTNode& program) {
+    std::stringstream source;
+    AsmCodegenContext ctx(source);
+    ctx.emit_prologue();
+    std::string target = ctx.alloc_reg();
+    program.gen_rvalue(ctx, target);
+    ctx.emit_epilogue(target);
+    return compiled_outcome(source.str(), ".s");
+}
+
+// Under -C, a statement whose value isn't used mustn't be dropped
+// if it traps in -e, even inside an 'if'.  One that can't may go.
+//   x = <x>
+//   <unused>
+//   5
+void structured_division_test() {
+    Ident &x = *new Ident("x");
+    ASTNode& int_min = *new Minus(*new Minus(*new IntConst(0), *new IntConst(INT_MAX)), *new IntConst(1));
+    Block& arm = *new Block();
+    arm.append(new Div(*new IntConst(1), x));
+    struct { ASTNode* x; ASTNode* unused; } cases[] = {
+        {new IntConst(0), new Div(*new IntConst(1), x)},
+        {new IntConst(0), new Div(*new Div(*new Div(*new IntConst(0), *new IntConst(1)), x), *new IntConst(5))},
+        {&int_min, new Div(x, *new IntConst(-1))},
+        {new IntConst(0), new If(*new Less(x, *new IntConst(1)), arm, *new Block())},
+        {new IntConst(1), new Div(*new IntConst(7), x)},
+    };
+    for (auto& c : cases) {
+        Block program;
+        program.append(new Assign(x, *c.x));
+        program.append(c.unused);
+        program.append(new IntConst(5));
+        std::string evaluated = outcome([&] { EvalContext ctx; return program.eval(ctx); });
+        std::string compiled = structured_outcome(program);
+        if (evaluated != compiled) {
+            std::cout << program.str() << ":  -e gives " << evaluated << ", -C " << compiled << std::endl;
+        }
+        assert(evaluated == compiled);
+    }
+    std::cout << "Structured C traps where evaluation does" << std::endl;
+}
+
+
+/* v<i> op (v<i+1> op (... v<depth>)), right-nested so that every level
+ * holds a register while the rest is computed.  The operators cycle
+ * through +, -, * and /, dividing by v<i>, so the values stay small.
+ */
+ASTNode* nested(int i, int depth) {
+    Ident& v = *new Ident("v" + std::to_string(i));
+    if (i == depth) { return &v; }
+    ASTNode& rest = *nested(i + 1, depth);
+    switch (i % 4) {
+        case 0: return new Plus(v, rest);
+        case 1: return new Minus(v, rest);
+        case 2: return new Times(v, rest);
+        default: return new Div(rest, v);
+    }
+}
+
+/* if <cond> then <then_value> else <else_value> fi */
+If* choose(ASTNode& cond, ASTNode& then_value, ASTNode& else_value) {
+    Block *then_part = new Block(), *else_part = new Block();
+    then_part->append(&then_value);
+    else_part->append(&else_value);
+    return new If(cond, *then_part, *else_part);
+}
+
+// The assembly from -s, assembled and run, should agree with eval,
+// including where the registers run out and the rest spill:
+//   x = <value>
+//   v<i> = x + i * 3 + 1, for i = 0 .. 24
+//   if v5 > nested(0, 24) or nested(1, 24) > v7 then nested(2, 24) else nested(3, 24) fi
+// and on >, or and elif by themselves:
+//   if x > 3 then 1 else 2 fi + if 3 > x then 10 else 20 fi
+//   if x > 5 or x < 0 then 10 elif x == 4 or 8 > x then 20 else 30 fi
+//   if x > 8 then 1 elif x > 3 then 2 elif x == 0 or x < 0 - 1 then 3 else 4 fi
+void asm_test() {
+    Ident &x = *new Ident("x");
+    auto var = [](int i) { return new Ident("v" + std::to_string(i)); };
+    auto num = [](int value) { return new IntConst(value); };
+    for (int value : {-3, -1, 0, 2, 4, 7, 9, 100}) {
+        std::vector<ASTNode*> programs;
+        programs.push_back(choose(*new Or(*new Greater(*var(5), *nested(0, 24)),
+                                          *new Greater(*nested(1, 24), *var(7))),
+                                  *nested(2, 24), *nested(3, 24)));
+        programs.push_back(new Plus(*choose(*new Greater(x, *num(3)), *num(1), *num(2)),
+                                    *choose(*new Greater(*num(3), x), *num(10), *num(20))));
+        If* inner = choose(*new Or(*new Equals(x, *num(4)), *new Greater(*num(8), x)), *num(20), *num(30));
+        programs.push_back(choose(*new Or(*new Greater(x, *num(5)), *new Less(x, *num(0))), *num(10), *inner));
+        If* last = choose(*new Or(*new Equals(x, *num(0)), *new Less(x, *new Minus(*num(0), *num(1)))),
+                          *num(3), *num(4));
+        If* middle = choose(*new Greater(x, *num(3)), *num(2), *last);
+        programs.push_back(choose(*new Greater(x, *num(8)), *num(1), *middle));
+
+        for (ASTNode* program : programs) {
+            Block* run = new Block();
+            run->append(new Assign(x, *num(value)));
+            for (int i = 0; i <= 24; ++i) {
+                run->append(new Assign(*var(i), *new Plus(x, *num(i * 3 + 1))));
+            }
+            run->append(program);
+            std::string want = outcome([&] { EvalContext ctx; return run->eval(ctx); });
+            std::string got = asm_outcome(*run);
+            if (got != want) {
+                std::cout << run->str() << ":  -e gives " << want << ", -s " << got << std::endl;
+            }
+            assert(got == want);
+        }
+    }
+    std::cout << "Assembly agrees with evaluation" << std::endl;
+}
+
+// An elif chain testing x against constants, each arm setting r:
+//   if x == <v1> then r = 1 elif x == <v2> then r = 2 ... else r = 0 fi
+// An entry for a variable other than x tests that instead.
+struct CaseTest { const char* var; int value; };
+If* case_chain(const std::vector<CaseTest>& tests) {
+    Ident& r = *new Ident("r");
+    Block* rest = new Block();
+    rest->append(new Assign(r, *new IntConst(0)));
+    If* chain = nullptr;
+    for (size_t i = tests.size(); i-- > 0; ) {
+        Block* then_part = new Block();
+        then_part->append(new Assign(r, *new IntConst((int) i + 1)));
+        chain = new If(*new Equals(*new Ident(tests[i].var), *new IntConst(tests[i].value)), *then_part, *rest);
+        rest = new Block();
+        rest->append(chain);
+    }
+    return chain;
+}
+
+/* For each value of x, run the chain and fold r into s:
+ *   y = 5
+ *   x = <value>; <chain>; s = s * 7 + r    ...
+ *   s
+ */
+Block* case_program(const std::vector<CaseTest>& tests, const std::vector<int>& values) {
+    Ident &r = *new Ident("r"), &s = *new Ident("s");
+    Block* program = new Block();
+    program->append(new Assign(*new Ident("y"), *new IntConst(5)));
+    for (int value : values) {
+        program->append(new Assign(*new Ident("x"), *new IntConst(value)));
+        program->append(case_chain(tests));
+        program->append(new Assign(s, *new Plus(*new Times(s, *new IntConst(7)), r)));
+    }
+    program->append(&s);
+    return program;
+}
+
+// make_switches must not change what a program does under -e, -C or
+// -s.  Only chains of at least three cases on one variable become
+// switches:  dense values get a table, sparse ones a hash.  A value
+// tested twice keeps its first arm, and a test of anything else ends
+// the chain and becomes, with what follows, the default.
+void switch_test() {
+    struct { std::vector<CaseTest> tests; bool becomes_switch; } chains[] = {
+        {{{"x", 1}, {"x", 2}}, false},
+        {{{"x", 1}, {"x", 2}, {"x", 3}, {"x", 5}}, true},
+        {{{"x", 4}, {"x", 6}, {"x", 4}, {"x", 5}}, true},
+        {{{"x", 1}, {"x", 2}, {"x", 3}, {"y", 5}, {"x", 4}}, true},
+        {{{"x", 7}, {"x", -50000}, {"x", 1000}, {"x", 8}}, true},
+    };
+    for (auto& c : chains) {
+        std::vector<int> values;
+        for (auto& t : c.tests) {
+            values.push_back(t.value - 1);
+            values.push_back(t.value);
+        }
+        values.push_back(99999);
+        Block* chain = case_program(c.tests, values);
+        Block* multiway = case_program(c.tests, values);
+        make_switches(*multiway);
+        for (size_t i = 2; i < multiway->stmts().size(); i += 3) {
+            assert((dynamic_cast<Switch*>(multiway->stmts()[i]) != nullptr) == c.becomes_switch);
+        }
+        std::string want = outcome([&] { EvalContext ctx; return chain->eval(ctx); });
+        std::string got = outcome([&] { EvalContext ctx; return multiway->eval(ctx); });
+        assert(got == want);
+        assert(structured_outcome(*chain) == want);
+        assert(structured_outcome(*multiway) == want);
+        assert(asm_outcome(*chain) == want);
+        assert(asm_outcome(*multiway) == want);
+    }
+    std::cout << "Switches agree with the elif chains they replace" << std::endl;
+}
+
 
 int main(int argc, char **argv) {
     IntConst *x = new IntConst(5);
@@ -61,4 +597,12 @@ int main(int argc, char **argv) {
     std::cout << "Evaluating " << assignment->str() << std::endl;
     EvalContext ctx;
     // std::cout << "Evaluates to " << assignment->eval(ctx) << std::endl;
+    incremental_test();
+    parallel_test();
+    dead_division_test();
+    residual_division_test();
+    structured_division_test();
+    switch_test();
+    asm_test();
+    hash_cons_test();
 }
@@ -0,0 +1,136 @@
+//
+// Does the compile-time calculator (ConstCalc.h) agree with the
+// real scanner, parser and ASTNode::eval?
+//
+// The static_asserts are evaluated by the compiler.  Then, at run
+// time, every program in the directories named on the command line
+// (samples by default) goes through both, and they must agree on the
+// value, or both reject it.
+//
+//     bin/test_constcalc [directory ...]
+//
+
+#include "ConstCalc.h"
+#include "ASTNode.h"
+#include "EvalContext.h"
+#include "TokenSource.h"
+#include "Messages.h"
+#include <dirent.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// samples/and.calc, samples/max.calc and samples/if.calc
+static_assert(constcalc::eval("x = 42 y = 52 z = x + y if z > y and y > x then z else x fi") == 94, "and");
+static_assert(constcalc::eval("x = 42\ny = 31\nif x > y then\n x\nelse\n y\nfi\n") == 42, "max");
+static_assert(constcalc::eval("x = 42 if x then 13 else 14 fi") == 13, "if");
+
+// Precedence and grouping
+static_assert(constcalc::eval("2 + 3 * 4") == 14, "* before +");
+static_assert(constcalc::eval("10 - 3 - 2") == 5, "- groups left");
+static_assert(constcalc::eval("100 / 10 / 5") == 2, "/ groups left");
+static_assert(constcalc::eval("(2 + 3) * 4") == 20, "parentheses");
+static_assert(constcalc::eval("if not 1 < 0 and 0 then 1 else 2 fi") == 2, "not binds looser than <, tighter than and");
+static_assert(constcalc::eval("if 1 or 0 and 0 then 1 else 2 fi") == 2, "and, or group left");
+
+// Statements, elif, and the value of an if without an else
+static_assert(constcalc::eval("x = 3 x = x * x x") == 9, "assignment");
+static_assert(constcalc::eval("x = 2 if x == 1 then 10 elif x == 2 then 20 else 30 fi") == 20, "elif");
+static_assert(constcalc::eval("if 0 then 5 fi") == 0, "no else");
+static_assert(constcalc::eval("x2 = 5 ifx = 2 x2 * ifx") == 10, "identifiers that start like keywords");
+static_assert(constcalc::eval("if 0 then 1 / 0 else 7 fi") == 7, "the arm not taken isn't evaluated");
+
+// A program that fails is not a constant expression:  constant<P>(0)
+// only exists if eval(P::text) can be a template argument.
+template <class P, int = constcalc::eval(P::text)>
+constexpr bool constant(int) { return true; }
+template <class P>
+constexpr bool constant(long) { return false; }
+struct Quotient { static constexpr const char* text = "x = 0 - 2147483647 - 1 x / 2"; };
+struct ZeroDivisor { static constexpr const char* text = "x = 0 7 / x"; };
+struct MinByMinusOne { static constexpr const char* text = "x = 0 - 2147483647 - 1 x / (0 - 1)"; };
+static_assert(constant<Quotient>(0), "INT_MIN / 2");
+static_assert(! constant<ZeroDivisor>(0), "division by zero");
+static_assert(! constant<MinByMinusOne>(0), "INT_MIN / -1");
+
+/* Parse and evaluate with the real thing.  False if it doesn't parse. */
+static bool reflex_bison_eval(const std::string& text, int& value) {
+    AST::NodeArena nodes;
+    AST::NodeArena::Use use(nodes);
+    AST::ASTNode* root = nullptr;
+    report::reset();
+    yy::LexerSource lexer(reflex::Input(text.data(), text.size()));
+    yy::parser parser(lexer, &root);
+    std::ostringstream discard;
+    std::streambuf* err = std::cerr.rdbuf(discard.rdbuf());
+    int result;
+    try {
+        result = parser.parse();
+    } catch (governor::LimitExceeded& e) {   // Too many errors
+        result = 1;
+    }
+    std::cerr.rdbuf(err);
+    if (result != 0 || ! report::ok() || root == nullptr) { return false; }
+    EvalContext ctx;
+    value = root->eval(ctx);
+    return true;
+}
+
+/* With room for bigger programs than the samples */
+static bool constcalc_eval(const std::string& text, int& value) {
+    try {
+        constcalc::Program<1 << 16, 256>* program =
+            new constcalc::Program<1 << 16, 256>(text.data(), (int) text.size());
+        value = program->eval();
+        delete program;
+        return true;
+    } catch (std::invalid_argument& e) {
+        return false;
+    }
+}
+
+int main(int argc, char** argv) {
+    // At run time, the same failures throw
+    int ignored;
+    for (const char* text : {ZeroDivisor::text, MinByMinusOne::text}) {
+        if (constcalc_eval(text, ignored)) {
+            std::cerr << text << ":  constcalc doesn't reject it" << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<std::string> dirs;
+    for (int i = 1; i < argc; ++i) { dirs.push_back(argv[i]); }
+    if (dirs.empty()) { dirs.push_back("samples"); }
+    int checked = 0;
+    int failed = 0;
+    for (const std::string& dir : dirs) {
+        DIR* d = opendir(dir.c_str());
+        if (! d) {
+            std::cerr << "Can't read directory " << dir << std::endl;
+            return 1;
+        }
+        while (struct dirent* entry = readdir(d)) {
+            std::string name = entry->d_name;
+            if (name[0] == '.') { continue; }
+            std::string path = dir + "/" + name;
+            std::ifstream in(path);
+            std::stringstream text;
+            text << in.rdbuf();
+            int expected = 0, actual = 0;
+            bool parsed = reflex_bison_eval(text.str(), expected);
+            bool constparsed = constcalc_eval(text.str(), actual);
+            ++checked;
+            if (parsed != constparsed || (parsed && expected != actual)) {
+                ++failed;
+                std::cerr << path << ":  ASTNode::eval " << (parsed ? std::to_string(expected) : "rejects")
+                          << ", constcalc " << (constparsed ? std::to_string(actual) : "rejects") << std::endl;
+            }
+        }
+        closedir(d);
+    }
+    std::cout << checked << " programs, " << failed << " disagreements" << std::endl;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,260 @@
+//
+// Does the recursive descent parser (DescentParser.h) do exactly what
+// the Bison parser does?  On generated programs, and on the same
+// programs with tokens dropped, repeated, swapped and inserted, both
+// must build the same tree, or else report the same errors at the same
+// places and recover (or give up) the same way.  Programs in the
+// directories named on the command line are checked too, and so are
+// some that nest far deeper than the machine stack would allow if
+// either parser recursed.
+//
+//     bin/test_descent [-n programs] [directory ...]
+//
+
+#include "DescentParser.h"
+#include "ASTNode.h"
+#include "TokenSource.h"
+#include "Messages.h"
+#include <dirent.h>
+#include <unistd.h>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+/* A tree too deep to print recursively:  its nodes, parents first */
+static void shape(std::ostream& out, AST::ASTNode* root) {
+    std::vector<AST::ASTNode*> nodes{root};
+    while (! nodes.empty()) {
+        AST::ASTNode* node = nodes.back();
+        nodes.pop_back();
+        if (! node) {
+            out << "null\n";
+            continue;
+        }
+        out << typeid(*node).name() << "\n";
+        std::vector<AST::ASTNode*> kids;
+        node->children(kids);
+        nodes.insert(nodes.end(), kids.rbegin(), kids.rend());
+    }
+}
+
+/* Everything one parser says about a program:  errors, then the tree */
+template <class Parser>
+static std::string parse(const std::string& text, bool& tree, bool deep) {
+    AST::NodeArena nodes;
+    AST::NodeArena::Use use(nodes);
+    AST::ASTNode* root = nullptr;
+    report::reset();
+    yy::LexerSource lexer(reflex::Input(text.data(), text.size()));
+    Parser parser(lexer, &root);
+    std::ostringstream out;
+    std::streambuf* err = std::cerr.rdbuf(out.rdbuf());
+    tree = false;
+    try {
+        out << "result " << parser.parse() << "\n";
+        if (report::ok() && root != nullptr) {
+            tree = true;
+            if (deep) {
+                shape(out, root);
+            } else {
+                AST::AST_print_context context;
+                root->json(out, context);
+            }
+        }
+    } catch (governor::LimitExceeded& e) {   // Too many errors
+        out << "bailed\n";
+    }
+    std::cerr.rdbuf(err);
+    return out.str();
+}
+
+static int checked = 0;
+static int failed = 0;
+static int rejected = 0;
+
+static void check(const std::string& name, const std::string& text, bool deep = false) {
+    bool tree;
+    std::string expected = parse<yy::parser>(text, tree, deep);
+    std::string actual = parse<yy::DescentParser>(text, tree, deep);
+    ++checked;
+    if (! tree) { ++rejected; }
+    if (expected != actual) {
+        ++failed;
+        std::cerr << name << ":\n" << text.substr(0, 1000) << "\nBison parser says\n" << expected.substr(0, 1000)
+                  << "\nbut descent parser says\n" << actual.substr(0, 1000) << std::endl;
+    }
+}
+
+static std::string repeat(const std::string& text, int n) {
+    std::string out;
+    for (int i = 0; i < n; ++i) { out += text; }
+    return out;
+}
+
+/* Parentheses, nots, operands on the right, ifs and elifs, nested n deep */
+static void deep(int n) {
+    check("deep parentheses", repeat("(", n) + "1" + repeat(")", n), true);
+    check("deep nots", "if " + repeat("not ", n) + "1 then 2 fi", true);
+    check("deep right operands", "1" + repeat(" - (2 * (x", n) + repeat("))", n), true);
+    check("deep ifs", repeat("if x then ", n) + "2" + repeat(" fi", n), true);
+    check("long elif chain", "if x then 1" + repeat(" elif x then 1", n) + " else 2 fi", true);
+    check("deep unclosed parentheses", repeat("(", n) + "1 + x y", true);
+    check("deep unclosed ifs", repeat("if not x then (", n) + "1", true);
+}
+
+/* Random programs, one token per word */
+class Generator {
+    unsigned int seed_;
+    int pick(int n) { return rand_r(&seed_) % n; }
+    void add(std::vector<std::string>& out, const char* word) { out.push_back(word); }
+public:
+    explicit Generator(unsigned int seed) : seed_{seed} {}
+
+    void leaf(std::vector<std::string>& out) {
+        const char* vars[] = {"x", "y", "z", "w"};
+        if (pick(3)) {
+            add(out, vars[pick(4)]);
+        } else {
+            out.push_back(std::to_string(pick(20)));
+        }
+    }
+
+    void expr(std::vector<std::string>& out, int depth) {
+        if (depth > 3 || pick(3) == 0) {
+            leaf(out);
+            return;
+        }
+        const char* ops[] = {"+", "-", "*", "/"};
+        bool parens = pick(3) == 0;
+        if (parens) { add(out, "("); }
+        expr(out, depth + 1);
+        add(out, ops[pick(4)]);
+        expr(out, depth + 1);
+        if (parens) { add(out, ")"); }
+    }
+
+    void cond(std::vector<std::string>& out, int depth) {
+        const char* cmps[] = {"<", ">", "<=", ">=", "=="};
+        int r = pick(10);
+        if (depth < 3 && r < 2) {
+            cond(out, depth + 1);
+            add(out, r == 0 ? "and" : "or");
+            cond(out, depth + 1);
+        } else if (depth < 3 && r < 4) {
+            add(out, "not");
+            cond(out, depth + 1);
+        } else if (r < 8) {
+            expr(out, 2);
+            add(out, cmps[pick(5)]);
+            expr(out, 2);
+        } else {
+            expr(out, 2);
+        }
+    }
+
+    void block(std::vector<std::string>& out, int depth) {
+        const char* vars[] = {"x", "y", "z", "w"};
+        int n = 1 + pick(3);
+        for (int i = 0; i < n; ++i) {
+            int r = pick(10);
+            if (depth < 3 && r < 3) {
+                add(out, "if");
+                cond(out, 0);
+                add(out, "then");
+                block(out, depth + 1);
+                while (pick(3) == 0) {
+                    add(out, "elif");
+                    cond(out, 0);
+                    add(out, "then");
+                    block(out, depth + 1);
+                }
+                if (pick(2)) {
+                    add(out, "else");
+                    block(out, depth + 1);
+                }
+                add(out, "fi");
+            } else if (r < 8) {
+                add(out, vars[pick(4)]);
+                add(out, "=");
+                expr(out, 0);
+            } else {
+                expr(out, 0);
+            }
+        }
+    }
+
+    /* Break a program in a few places */
+    void mutate(std::vector<std::string>& words) {
+        const char* junk[] = {"if", "then", "elif", "else", "fi", "and", "or", "not", "(", ")",
+                              "=", "==", "<", "+", "*", "x", "7", "$"};
+        int n = 1 + pick(4);
+        for (int i = 0; i < n; ++i) {
+            int at = pick((int) words.size() + 1);
+            switch (pick(4)) {
+                case 0:
+                    if (at < (int) words.size()) { words.erase(words.begin() + at); }
+                    break;
+                case 1:
+                    words.insert(words.begin() + at, junk[pick(sizeof junk / sizeof junk[0])]);
+                    break;
+                case 2:
+                    if (at < (int) words.size()) { words.insert(words.begin() + at, words[at]); }
+                    break;
+                default:
+                    if (at + 1 < (int) words.size()) { std::swap(words[at], words[at + 1]); }
+            }
+        }
+    }
+
+    std::string text(const std::vector<std::string>& words) {
+        std::string text;
+        for (const std::string& word : words) {
+            text += word;
+            text += pick(4) ? " " : "\n";
+        }
+        return text;
+    }
+};
+
+int main(int argc, char** argv) {
+    int programs = 5000;
+    char opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        if (opt == 'n') { programs = atoi(optarg); }
+    }
+    std::vector<std::string> dirs;
+    for (int i = optind; i < argc; ++i) { dirs.push_back(argv[i]); }
+    if (dirs.empty()) { dirs.push_back("samples"); }
+    for (const std::string& dir : dirs) {
+        DIR* d = opendir(dir.c_str());
+        if (! d) {
+            std::cerr << "Can't read directory " << dir << std::endl;
+            return 1;
+        }
+        while (struct dirent* entry = readdir(d)) {
+            std::string name = entry->d_name;
+            if (name[0] == '.') { continue; }
+            std::ifstream in(dir + "/" + name);
+            std::stringstream text;
+            text << in.rdbuf();
+            check(dir + "/" + name, text.str());
+        }
+        closedir(d);
+    }
+    deep(300000);
+    Generator gen(461);
+    for (int i = 0; i < programs; ++i) {
+        std::vector<std::string> words;
+        gen.block(words, 0);
+        check("program " + std::to_string(i), gen.text(words));
+        gen.mutate(words);
+        check("broken program " + std::to_string(i), gen.text(words));
+    }
+    std::cout << checked << " programs (" << rejected << " with errors), "
+              << failed << " disagreements" << std::endl;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,160 @@
+//
+// Do the fast scanner (FastScanner.h) and the pipelined one
+// (PipelinedSource.h, parser -t) produce exactly what the reflex
+// scanner does?  Same tokens, semantic values, locations and error
+// messages, for every program in the directories named on the command
+// line (samples by default), for some inputs made to land on awkward
+// chunk boundaries, for a lot of random ones, and for a few long
+// enough to go round the pipelined scanner's ring many times.
+//
+//     bin/test_scanner [directory ...]
+//
+
+#include "FastScanner.h"
+#include "PipelinedSource.h"
+#include "TokenSource.h"
+#include "Messages.h"
+#include <dirent.h>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/* Everything the scanner that make() returns says, one line per token
+ * or message.  With 'apart', the messages come after all the tokens,
+ * for the pipelined scanner, whose thread writes them whenever it gets
+ * to them; the scanner is made after std::cerr is redirected and gone
+ * before it is put back for the same reason.
+ */
+template <class Make>
+static std::string scan(Make make, bool apart = false) {
+    std::ostringstream out, messages;
+    std::streambuf* err = std::cerr.rdbuf(apart ? messages.rdbuf() : out.rdbuf());
+    report::reset();
+    try {
+        std::unique_ptr<yy::TokenSource> source(make());
+        for (;;) {
+            yy::parser::semantic_type value;
+            yy::location loc;
+            int kind = source->yylex(&value, &loc);
+            if (kind == 0) { break; }
+            out << kind << " " << loc.begin.line << "." << loc.begin.column
+                << "-" << loc.end.line << "." << loc.end.column;
+            if (kind == yy::parser::token::NUMBER) { out << " " << value.num; }
+            if (kind == yy::parser::token::IDENT) {
+                out << " " << value.str;
+                free(value.str);
+            }
+            out << "\n";
+        }
+    } catch (governor::LimitExceeded& e) {   // Too many errors
+        out << "bailed\n";
+    }
+    std::cerr.rdbuf(err);
+    return out.str() + messages.str();
+}
+
+static int checked = 0;
+static int failed = 0;
+
+static void compare(const std::string& name, const std::string& expected,
+                    const char* scanner, const std::string& actual) {
+    if (expected != actual) {
+        ++failed;
+        std::cerr << name << ":  reflex scanner gives\n" << expected.substr(0, 2000)
+                  << "but " << scanner << " scanner gives\n" << actual.substr(0, 2000) << std::endl;
+    }
+}
+
+static void check(const std::string& name, const std::string& text) {
+    auto in = [&text] { return reflex::Input(text.data(), text.size()); };
+    std::string expected = scan([&] { return new yy::LexerSource(in()); });
+    ++checked;
+    compare(name, expected, "fast", scan([&] { return new yy::FastScanner(text); }));
+    expected = scan([&] { return new yy::LexerSource(in()); }, true);
+    compare(name, expected, "pipelined", scan([&] { return new yy::PipelinedSource(in()); }, true));
+}
+
+/* White space, words and numbers that end just before, at and after
+ * the ends of 16 and 32 byte chunks, and things that look like them.
+ */
+static void boundaries() {
+    const char* fragments[] = {
+        "x", "if", "iff", "fi", "elif", "then", "else", "and", "or", "not", "nothing", "_a1",
+        "0", "007", "2147483647", "2147483648", "99999999999999999999", "12ab",
+        "=", "==", "<", "<=", ">", ">=", "+", "-", "*", "/", "(", ")",
+        "\t", "!", "\r", "\xc3\xa9", "#"
+    };
+    for (int lead = 0; lead < 70; ++lead) {
+        for (const char* fragment : fragments) {
+            std::string spaces(lead, ' ');
+            std::string newlines(lead, '\n');
+            std::string word(lead + 1, 'w');
+            check("boundary", spaces + fragment + " y");
+            check("boundary", newlines + fragment + "\n" + spaces + fragment);
+            check("boundary", word + fragment);
+            check("boundary", std::string(lead + 1, '7') + fragment);
+        }
+    }
+}
+
+/* Random text from the calculator's alphabet, and a few other things */
+static void random_inputs(int n) {
+    const char* pieces[] = {
+        " ", "  ", "\n", "        ", "\n\n ", "x", "y1", "long_identifier_name", "if", "then",
+        "elif", "else", "fi", "and", "or", "not", "12", "0", "4294967296", "=", "==", "<",
+        "<=", ">", ">=", "+", "-", "*", "/", "(", ")", "\t", "$", "ifx", "fi2"
+    };
+    const int count = sizeof pieces / sizeof pieces[0];
+    unsigned int seed = 461;
+    for (int i = 0; i < n; ++i) {
+        std::string text;
+        int length = rand_r(&seed) % 200;
+        for (int j = 0; j < length; ++j) { text += pieces[rand_r(&seed) % count]; }
+        check("random " + std::to_string(i), text);
+    }
+}
+
+/* Many times the size of the pipelined scanner's ring */
+static void long_inputs() {
+    const char* pieces[] = {"x", " ", "=", "12", "\n", "y_2", "+", "(", ")", "if", "then", "fi"};
+    const int count = sizeof pieces / sizeof pieces[0];
+    unsigned int seed = 461;
+    for (int i = 0; i < 4; ++i) {
+        std::string text;
+        for (int j = 0; j < 100000; ++j) { text += pieces[rand_r(&seed) % count]; }
+        if (i == 3) { text += " $ ! $ $ ! $ "; }   // Errors, after most of the tokens
+        check("long " + std::to_string(i), text);
+    }
+}
+
+int main(int argc, char** argv) {
+    std::cout << "Fast scanner uses " << yy::FastScanner::simd() << std::endl;
+    std::vector<std::string> dirs;
+    for (int i = 1; i < argc; ++i) { dirs.push_back(argv[i]); }
+    if (dirs.empty()) { dirs.push_back("samples"); }
+    for (const std::string& dir : dirs) {
+        DIR* d = opendir(dir.c_str());
+        if (! d) {
+            std::cerr << "Can't read directory " << dir << std::endl;
+            return 1;
+        }
+        while (struct dirent* entry = readdir(d)) {
+            std::string name = entry->d_name;
+            if (name[0] == '.') { continue; }
+            std::ifstream in(dir + "/" + name);
+            std::stringstream text;
+            text << in.rdbuf();
+            check(dir + "/" + name, text.str());
+        }
+        closedir(d);
+    }
+    boundaries();
+    random_inputs(5000);
+    long_inputs();
+    std::cout << checked << " inputs, " << failed << " disagreements" << std::endl;
+    return failed ? 1 : 0;
+}